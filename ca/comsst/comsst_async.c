@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <comsst_ca_api.h>
+#include <comsst_ta.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <nuttx/config.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee_client_api.h>
+#include <teec_trace.h>
+#include <unistd.h>
+
+#include "comsst_client.h"
+
+/*
+ * A worker thread owns a comsst client and runs the requests queued by
+ * the other threads. Whatever is queued when it picks work up goes to the
+ * TA at once, as a batch if there is more than one request, so the worker
+ * never waits for anything but the TA while requests are queued.
+ */
+
+struct comsst_async_req {
+    struct comsst_async_req* next;
+    uint32_t cmd;
+    uint8_t* scope;
+    uint8_t* name;
+    bool is_deletable;
+    uint8_t* buff;
+    uint32_t len;
+    uint32_t res;
+    uint32_t out_len;
+    comsst_async_cb_t cb;
+    void* arg;
+    uint8_t strs[]; /* scope and name, then the data of a write */
+};
+
+struct comsst_async_list {
+    struct comsst_async_req* head;
+    struct comsst_async_req* tail;
+};
+
+struct comsst_async {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* a request is queued, or stop is set */
+    pthread_cond_t idle; /* the queue is empty and nothing is in flight */
+    pthread_t worker;
+    comsst_client_t* client;
+    struct comsst_async_list queue;
+    uint32_t queued;
+    bool busy;
+    bool stop;
+
+    /* With a pollable handle, the requests run wait here for dispatch */
+
+    bool pollable;
+    struct comsst_async_list done;
+    int fds[2];
+};
+
+static void comsst_async_push(struct comsst_async_list* list,
+    struct comsst_async_req* req)
+{
+    req->next = NULL;
+    if (list->tail != NULL) {
+        list->tail->next = req;
+    } else {
+        list->head = req;
+    }
+
+    list->tail = req;
+}
+
+/* Take the whole list */
+
+static struct comsst_async_req* comsst_async_take(
+    struct comsst_async_list* list)
+{
+    struct comsst_async_req* head = list->head;
+
+    list->head = NULL;
+    list->tail = NULL;
+    return head;
+}
+
+/* Call the callbacks of a list of requests run and free them */
+
+static void comsst_async_complete(struct comsst_async_req* req)
+{
+    struct comsst_async_req* next;
+
+    for (; req != NULL; req = next) {
+        next = req->next;
+        if (req->cb != NULL) {
+            req->cb(req->res,
+                req->cmd == TA_COMSST_CMD_RD ? req->buff : NULL,
+                req->out_len, req->arg);
+        }
+
+        free(req);
+    }
+}
+
+/*
+ * Run a request alone, with the same results as in a batch: the cache of
+ * the process is not looked at and a check returns a TEEC_* value
+ */
+
+static uint32_t comsst_async_run_one(comsst_client_t* client,
+    struct comsst_async_req* req)
+{
+    switch (req->cmd) {
+    case TA_COMSST_CMD_RD:
+        req->out_len = req->len;
+        return comsst_client_read_tee(client, req->scope, req->name,
+            req->is_deletable, req->buff, &req->out_len);
+    case TA_COMSST_CMD_WR:
+        return comsst_client_data_write(client, req->scope, req->name,
+            req->is_deletable, req->buff, req->len);
+    case TA_COMSST_CMD_DEL:
+        return comsst_client_data_delete(client, req->scope, req->name,
+            req->is_deletable);
+    default:
+        return comsst_client_check_tee(client, req->scope, req->name,
+            req->is_deletable);
+    }
+}
+
+static uint32_t comsst_async_add(comsst_batch_t* batch,
+    struct comsst_async_req* req)
+{
+    switch (req->cmd) {
+    case TA_COMSST_CMD_RD:
+        return comsst_batch_add_read(batch, req->scope, req->name,
+            req->is_deletable, req->buff, req->len);
+    case TA_COMSST_CMD_WR:
+        return comsst_batch_add_write(batch, req->scope, req->name,
+            req->is_deletable, req->buff, req->len);
+    case TA_COMSST_CMD_DEL:
+        return comsst_batch_add_delete(batch, req->scope, req->name,
+            req->is_deletable);
+    default:
+        return comsst_batch_add_check(batch, req->scope, req->name,
+            req->is_deletable);
+    }
+}
+
+/*
+ * Run a list of requests in order with one invoke, their results are
+ * left in the requests
+ */
+
+static void comsst_async_run(comsst_client_t* client,
+    struct comsst_async_req* reqs)
+{
+    struct comsst_async_req* req;
+    comsst_batch_t* batch;
+    uint32_t res;
+    uint32_t i;
+
+    if (reqs->next == NULL) {
+        reqs->res = comsst_async_run_one(client, reqs);
+        return;
+    }
+
+    res = comsst_batch_create(&batch);
+    for (req = reqs; req != NULL && res == TEEC_SUCCESS; req = req->next) {
+        res = comsst_async_add(batch, req);
+    }
+
+    /* A batch that can not be built is run one request after another */
+
+    if (res != TEEC_SUCCESS) {
+        for (req = reqs; req != NULL; req = req->next) {
+            req->res = comsst_async_run_one(client, req);
+        }
+
+        comsst_batch_destroy(batch);
+        return;
+    }
+
+    res = comsst_client_batch_run(client, batch, false);
+    for (req = reqs, i = 0; req != NULL; req = req->next, i++) {
+        req->res = res != TEEC_SUCCESS
+            ? res
+            : comsst_batch_get_result(batch, i, &req->out_len);
+    }
+
+    comsst_batch_destroy(batch);
+}
+
+static void* comsst_async_worker(void* priv)
+{
+    struct comsst_async* async = priv;
+    struct comsst_async_req* reqs;
+    struct comsst_async_req* req;
+    uint8_t token = 0;
+
+    pthread_mutex_lock(&async->lock);
+    for (;;) {
+        while (async->queued == 0 && !async->stop) {
+            pthread_cond_wait(&async->cond, &async->lock);
+        }
+
+        if (async->queued == 0) {
+            break;
+        }
+
+        reqs = comsst_async_take(&async->queue);
+        async->queued = 0;
+        async->busy = true;
+        pthread_mutex_unlock(&async->lock);
+
+        comsst_async_run(async->client, reqs);
+        if (!async->pollable) {
+            comsst_async_complete(reqs);
+        }
+
+        pthread_mutex_lock(&async->lock);
+        async->busy = false;
+        if (async->pollable) {
+            while (reqs != NULL) {
+                req = reqs;
+                reqs = reqs->next;
+                comsst_async_push(&async->done, req);
+            }
+
+            /* A full pipe already wakes the poller up */
+
+            write(async->fds[1], &token, sizeof(token));
+        }
+
+        if (async->queued == 0) {
+            pthread_cond_broadcast(&async->idle);
+        }
+    }
+
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+uint32_t comsst_async_open(comsst_async_t** async, bool pollable)
+{
+    struct comsst_async* a;
+    pthread_attr_t attr;
+    uint32_t res;
+
+    if (async == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    a = calloc(1, sizeof(*a));
+    if (a == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    a->fds[0] = -1;
+    a->fds[1] = -1;
+    a->pollable = pollable;
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->cond, NULL);
+    pthread_cond_init(&a->idle, NULL);
+
+    res = comsst_client_open(&a->client);
+    if (res != TEEC_SUCCESS) {
+        goto err;
+    }
+
+    if (pollable) {
+        if (pipe(a->fds) < 0) {
+            EMSG("pipe failed with errno %d\n", errno);
+            res = TEEC_ERROR_GENERIC;
+            goto err;
+        }
+
+        fcntl(a->fds[0], F_SETFL, fcntl(a->fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(a->fds[1], F_SETFL, fcntl(a->fds[1], F_GETFL) | O_NONBLOCK);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, CONFIG_CA_COMSST_ASYNC_STACKSIZE);
+    if (pthread_create(&a->worker, &attr, comsst_async_worker, a) != 0) {
+        EMSG("pthread_create failed\n");
+        pthread_attr_destroy(&attr);
+        res = TEEC_ERROR_GENERIC;
+        goto err;
+    }
+
+    pthread_attr_destroy(&attr);
+    *async = a;
+    return TEEC_SUCCESS;
+
+err:
+    if (a->fds[0] >= 0) {
+        close(a->fds[0]);
+        close(a->fds[1]);
+    }
+
+    if (a->client != NULL) {
+        comsst_client_close(a->client);
+    }
+
+    pthread_cond_destroy(&a->idle);
+    pthread_cond_destroy(&a->cond);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+    return res;
+}
+
+void comsst_async_close(comsst_async_t* async)
+{
+    if (async == NULL) {
+        return;
+    }
+
+    /* The worker runs whatever is queued before it stops */
+
+    pthread_mutex_lock(&async->lock);
+    async->stop = true;
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->worker, NULL);
+
+    comsst_async_complete(comsst_async_take(&async->done));
+    if (async->pollable) {
+        close(async->fds[0]);
+        close(async->fds[1]);
+    }
+
+    comsst_client_close(async->client);
+    pthread_cond_destroy(&async->idle);
+    pthread_cond_destroy(&async->cond);
+    pthread_mutex_destroy(&async->lock);
+    free(async);
+}
+
+int comsst_async_get_fd(comsst_async_t* async)
+{
+    return async != NULL && async->pollable ? async->fds[0] : -1;
+}
+
+void comsst_async_dispatch(comsst_async_t* async)
+{
+    struct comsst_async_req* reqs;
+    uint8_t tokens[16];
+
+    if (async == NULL || !async->pollable) {
+        return;
+    }
+
+    /* Drain the pipe first, a completion after it wakes the poller again */
+
+    while (read(async->fds[0], tokens, sizeof(tokens)) > 0) {
+    }
+
+    pthread_mutex_lock(&async->lock);
+    reqs = comsst_async_take(&async->done);
+    pthread_mutex_unlock(&async->lock);
+    comsst_async_complete(reqs);
+}
+
+void comsst_async_flush(comsst_async_t* async)
+{
+    if (async == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&async->lock);
+    while (async->queued > 0 || async->busy) {
+        pthread_cond_wait(&async->idle, &async->lock);
+    }
+
+    pthread_mutex_unlock(&async->lock);
+}
+
+/*
+ * Queue a request, copying the scope, the name and the data of a write so
+ * that the caller can reuse them as soon as this returns
+ */
+
+static uint32_t comsst_async_submit(comsst_async_t* async, uint32_t cmd,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len, comsst_async_cb_t cb, void* arg)
+{
+    struct comsst_async_req* req;
+    size_t scope_len;
+    size_t name_len;
+    size_t data_len = cmd == TA_COMSST_CMD_WR ? len : 0;
+
+    if (async == NULL || scope == NULL || name == NULL
+        || (len > 0 && buff == NULL)) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    scope_len = strlen((char*)scope);
+    name_len = strlen((char*)name);
+    if (scope_len + name_len > COMSST_NAME_MAX) {
+        EMSG("Length of scope and name is too long\n");
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    req = malloc(sizeof(*req) + scope_len + name_len + 2 + data_len);
+    if (req == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    req->cmd = cmd;
+    req->scope = req->strs;
+    req->name = req->strs + scope_len + 1;
+    memcpy(req->scope, scope, scope_len + 1);
+    memcpy(req->name, name, name_len + 1);
+    req->is_deletable = is_deletable;
+    req->buff = buff;
+    req->len = len;
+    req->res = TEEC_ERROR_BAD_STATE;
+    req->out_len = 0;
+    req->cb = cb;
+    req->arg = arg;
+    if (data_len > 0) {
+        req->buff = req->name + name_len + 1;
+        memcpy(req->buff, buff, data_len);
+    }
+
+    /* A full queue is reported rather than blocking the caller */
+
+    pthread_mutex_lock(&async->lock);
+    if (async->queued >= CONFIG_CA_COMSST_ASYNC_QUEUE_SIZE || async->stop) {
+        pthread_mutex_unlock(&async->lock);
+        free(req);
+        return TEEC_ERROR_BUSY;
+    }
+
+    comsst_async_push(&async->queue, req);
+    async->queued++;
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+    return TEEC_SUCCESS;
+}
+
+uint32_t comsst_async_read(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len,
+    comsst_async_cb_t cb, void* arg)
+{
+    return comsst_async_submit(async, TA_COMSST_CMD_RD, scope, name,
+        is_deletable, buff, len, cb, arg);
+}
+
+uint32_t comsst_async_write(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len,
+    comsst_async_cb_t cb, void* arg)
+{
+    return comsst_async_submit(async, TA_COMSST_CMD_WR, scope, name,
+        is_deletable, buff, len, cb, arg);
+}
+
+uint32_t comsst_async_delete(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, comsst_async_cb_t cb, void* arg)
+{
+    return comsst_async_submit(async, TA_COMSST_CMD_DEL, scope, name,
+        is_deletable, NULL, 0, cb, arg);
+}
+
+uint32_t comsst_async_check(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, comsst_async_cb_t cb, void* arg)
+{
+    return comsst_async_submit(async, TA_COMSST_CMD_CHK, scope, name,
+        is_deletable, NULL, 0, cb, arg);
+}
+
+/* The handle of the comsst_data_*_async() calls, opened on first use */
+
+static pthread_once_t g_async_once = PTHREAD_ONCE_INIT;
+static comsst_async_t* g_async;
+
+static void comsst_async_init(void)
+{
+    if (comsst_async_open(&g_async, false) != TEEC_SUCCESS) {
+        g_async = NULL;
+    }
+}
+
+static comsst_async_t* comsst_async_default(void)
+{
+    pthread_once(&g_async_once, comsst_async_init);
+    return g_async;
+}
+
+uint32_t comsst_data_read_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, comsst_async_cb_t cb,
+    void* arg)
+{
+    comsst_async_t* async = comsst_async_default();
+
+    return async != NULL
+        ? comsst_async_read(async, scope, name, is_deletable, buff, len, cb,
+              arg)
+        : TEEC_ERROR_COMMUNICATION;
+}
+
+uint32_t comsst_data_write_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, comsst_async_cb_t cb,
+    void* arg)
+{
+    comsst_async_t* async = comsst_async_default();
+
+    return async != NULL
+        ? comsst_async_write(async, scope, name, is_deletable, buff, len,
+              cb, arg)
+        : TEEC_ERROR_COMMUNICATION;
+}
+
+uint32_t comsst_data_delete_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_async_cb_t cb, void* arg)
+{
+    comsst_async_t* async = comsst_async_default();
+
+    return async != NULL
+        ? comsst_async_delete(async, scope, name, is_deletable, cb, arg)
+        : TEEC_ERROR_COMMUNICATION;
+}
@@ -14,437 +14,1904 @@
  * limitations under the License.
  */
 
+#include <comsst_ca_api.h>
 #include <comsst_ta.h>
 #include <nuttx/config.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <tee_client_api.h>
+#include <tee_shm_pool.h>
 #include <teec_trace.h>
 
-#define MAX_LEN_OF_FULLNAME (30)
+#include "comsst_cache.h"
+#include "comsst_client.h"
 
-uint32_t comsst_data_read(uint8_t* scope, uint8_t* name, bool is_deletable,
-    uint8_t* buff, uint32_t* out_len)
-{
-    TEEC_Result res = TEEC_ERROR_GENERIC;
+#define MAX_LEN_OF_FULLNAME COMSST_NAME_MAX
+
+struct comsst_client {
     TEEC_Context ctx;
     TEEC_Session sess;
+    bool sess_opened;
+    struct tee_shm_pool pool;
+};
+
+static TEEC_Result comsst_client_open_session(comsst_client_t* client)
+{
+    TEEC_Result res;
     TEEC_Operation op;
     TEEC_UUID uuid = TA_COMSST_UUID;
-    TEEC_SharedMemory io_shm;
     uint32_t err_origin;
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
+        TEEC_NONE);
+
+    DMSG("TEEC_OpenSession...\n");
+    res = TEEC_OpenSession(&client->ctx, &client->sess, &uuid,
+        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
+            res, err_origin);
+        return res;
+    }
+
+    client->sess_opened = true;
+    return TEEC_SUCCESS;
+}
+
+static void comsst_client_close_session(comsst_client_t* client)
+{
+    if (client->sess_opened) {
+        DMSG("TEEC_CloseSession...\n");
+        TEEC_CloseSession(&client->sess);
+        client->sess_opened = false;
+    }
+}
+
+/*
+ * Invoke a command on the session of the client. The session is reopened
+ * and the command is sent once more if the TA instance has gone away,
+ * e.g. the TA panicked or the TEE side was restarted.
+ */
+
+static TEEC_Result comsst_client_invoke(comsst_client_t* client,
+    uint32_t cmd, TEEC_Operation* op)
+{
+    TEEC_Result res;
+    uint32_t err_origin;
+    int retry = 1;
+
+    do {
+        if (!client->sess_opened) {
+            res = comsst_client_open_session(client);
+            if (res != TEEC_SUCCESS) {
+                return res;
+            }
+        }
+
+        res = TEEC_InvokeCommand(&client->sess, cmd, op, &err_origin);
+        if (res == TEEC_SUCCESS) {
+            break;
+        }
+
+        /*
+         * A result of the TA, e.g. an item that does not exist, is an
+         * answer the caller handles and the TA logs what is unexpected
+         */
+
+        if (err_origin != TEEC_ORIGIN_TRUSTED_APP) {
+            EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin "
+                 "0x%08lx\n", res, err_origin);
+        }
+
+        if (res != TEEC_ERROR_TARGET_DEAD
+            && (res != TEEC_ERROR_COMMUNICATION
+                || err_origin == TEEC_ORIGIN_TRUSTED_APP)) {
+            break;
+        }
+
+        comsst_client_close_session(client);
+    } while (retry--);
+
+    return res;
+}
+
+/*
+ * Get a slab for "scope + name" followed by data_len bytes and put the
+ * name at its head, returns the length of the full name.
+ */
+
+static TEEC_Result comsst_client_prepare(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, uint32_t data_len,
+    struct tee_shm_slab* slab, uint32_t* fullname_len)
+{
+    TEEC_Result res;
+    size_t scope_len = strlen((char*)scope);
+    size_t name_len = strlen((char*)name);
+
+    if (scope_len + name_len > MAX_LEN_OF_FULLNAME) {
+        EMSG("Length of scope and name is too long\n");
+        return TEEC_ERROR_GENERIC;
+    }
+
+    res = tee_shm_pool_alloc(&client->pool, scope_len + name_len + data_len,
+        slab);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    memcpy(slab->buffer, scope, scope_len);
+    memcpy((uint8_t*)slab->buffer + scope_len, name, name_len);
+    *fullname_len = scope_len + name_len;
+    return TEEC_SUCCESS;
+}
+
+/*
+ * Point a partial memref at size bytes found offset bytes into a slab
+ */
+
+static void comsst_memref_at(const struct tee_shm_slab* slab, size_t offset,
+    size_t size, TEEC_Parameter* param)
+{
+    tee_shm_pool_memref(slab, offset + size, param);
+    param->memref.offset += offset;
+    param->memref.size = size;
+}
+
+/*
+ * Build "scope + name" into fullname, which holds MAX_LEN_OF_FULLNAME
+ * bytes
+ */
+
+static TEEC_Result comsst_fullname(uint8_t* scope, uint8_t* name,
+    uint8_t* fullname, uint32_t* fullname_len)
+{
+    size_t scope_len = strlen((char*)scope);
+    size_t name_len = strlen((char*)name);
+
+    if (scope_len + name_len > MAX_LEN_OF_FULLNAME) {
+        return TEEC_ERROR_GENERIC;
+    }
+
+    memcpy(fullname, scope, scope_len);
+    memcpy(fullname + scope_len, name, name_len);
+    *fullname_len = scope_len + name_len;
+    return TEEC_SUCCESS;
+}
+
+static bool comsst_cache_lookup(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t* out_len, TEEC_Result* res)
+{
+    uint8_t fullname[MAX_LEN_OF_FULLNAME];
+    uint32_t fullname_len;
+
+    return comsst_fullname(scope, name, fullname, &fullname_len)
+            == TEEC_SUCCESS
+        && comsst_cache_get(fullname, fullname_len, is_deletable, buff,
+            out_len, res);
+}
+
+/*
+ * Cache the data of an item read or written in the TEE, gen is the cache
+ * generation sampled before, see comsst_cache_put()
+ */
+
+static void comsst_cache_fill(uint8_t* scope, uint8_t* name,
+    bool is_deletable, const uint8_t* data, uint32_t len, uint32_t gen)
+{
+    uint8_t fullname[MAX_LEN_OF_FULLNAME];
+    uint32_t fullname_len;
+
+    if (comsst_fullname(scope, name, fullname, &fullname_len)
+        == TEEC_SUCCESS) {
+        comsst_cache_put(fullname, fullname_len, is_deletable, data, len,
+            gen);
+    }
+}
+
+static void comsst_cache_drop(uint8_t* scope, uint8_t* name,
+    bool is_deletable)
+{
+    uint8_t fullname[MAX_LEN_OF_FULLNAME];
+    uint32_t fullname_len;
+
+    if (comsst_fullname(scope, name, fullname, &fullname_len)
+        == TEEC_SUCCESS) {
+        comsst_cache_invalidate(fullname, fullname_len, is_deletable);
+    }
+}
+
+uint32_t comsst_client_open(comsst_client_t** client)
+{
+    TEEC_Result res;
+    comsst_client_t* c;
+
+    if (client == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    /* Initialize a context connecting us to the TEE */
+
+    DMSG("TEEC_InitializeContext...\n");
+    res = TEEC_InitializeContext(NULL, &c->ctx);
+
+    if (res != TEEC_SUCCESS) {
+        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
+        free(c);
+        return res;
+    }
+
+    res = comsst_client_open_session(c);
+    if (res != TEEC_SUCCESS) {
+        DMSG("TEEC_FinalizeContext...\n");
+        TEEC_FinalizeContext(&c->ctx);
+        free(c);
+        return res;
+    }
+
+    tee_shm_pool_init(&c->pool, &c->ctx);
+    *client = c;
+    return TEEC_SUCCESS;
+}
+
+void comsst_client_close(comsst_client_t* client)
+{
+    if (client == NULL) {
+        return;
+    }
+
+    comsst_client_close_session(client);
+    tee_shm_pool_deinit(&client->pool);
+    DMSG("TEEC_FinalizeContext...\n");
+    TEEC_FinalizeContext(&client->ctx);
+    free(client);
+}
+
+void comsst_client_get_shm_stats(comsst_client_t* client,
+    struct tee_shm_pool_stats* stats)
+{
+    tee_shm_pool_get_stats(&client->pool, stats);
+}
+
+TEEC_Result comsst_client_read_tee(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, *out_len, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, *out_len, &op.params[2]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_RD, &op);
+    if (res != TEEC_SUCCESS) {
+        goto out;
+    }
+
+    if (op.params[0].value.b > *out_len) {
+        *out_len = op.params[0].value.b;
+        res = TEEC_ERROR_SHORT_BUFFER;
+        goto out;
+    }
+
+    *out_len = op.params[0].value.b;
+    memcpy(buff, (uint8_t*)slab.buffer + fullname_len, *out_len);
+
+out:
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+uint32_t comsst_client_data_read_ex(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len,
+    uint32_t flags)
+{
+    TEEC_Result res;
+    uint32_t gen;
+
+    if (comsst_cache_lookup(scope, name, is_deletable, buff, out_len, &res)) {
+        return res;
+    }
+
+    gen = comsst_cache_generation();
+    res = comsst_client_read_tee(client, scope, name, is_deletable, buff,
+        out_len);
+    if (res == TEEC_SUCCESS && (flags & COMSST_FLAG_CACHEABLE)) {
+        comsst_cache_fill(scope, name, is_deletable, buff, *out_len, gen);
+    }
+
+    return res;
+}
+
+uint32_t comsst_client_data_read(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len)
+{
+    return comsst_client_data_read_ex(client, scope, name, is_deletable,
+        buff, out_len, 0);
+}
+
+static TEEC_Result comsst_client_write_tee(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len, uint32_t flags)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, len, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    memcpy((uint8_t*)slab.buffer + fullname_len, buff, len);
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    if (flags & COMSST_FLAG_COMPRESS) {
+        op.params[0].value.b |= COMSST_ITEM_COMPRESS;
+    }
+
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, len, &op.params[2]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_WR, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+/*
+ * A successful cacheable write updates the cache, anything else drops the
+ * item from it as its content in storage is not known anymore
+ */
+
+uint32_t comsst_client_data_write_ex(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len, uint32_t flags)
+{
+    TEEC_Result res;
+    uint32_t gen;
+
+    gen = comsst_cache_generation();
+    res = comsst_client_write_tee(client, scope, name, is_deletable, buff,
+        len, flags);
+    if (res == TEEC_SUCCESS && (flags & COMSST_FLAG_CACHEABLE)) {
+        comsst_cache_fill(scope, name, is_deletable, buff, len, gen);
+    } else {
+        comsst_cache_drop(scope, name, is_deletable);
+    }
+
+    return res;
+}
+
+uint32_t comsst_client_data_write(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_client_data_write_ex(client, scope, name, is_deletable,
+        buff, len, 0);
+}
+
+uint32_t comsst_client_data_delete(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, 0, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_DEL, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
+
+TEEC_Result comsst_client_check_tee(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, 0, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_CHK, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+uint32_t comsst_client_data_check(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    return comsst_client_check_tee(client, scope, name, is_deletable)
+        == TEEC_SUCCESS;
+}
+
+static TEEC_Result comsst_client_verify(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, const uint8_t* buff,
+    uint32_t len, uint32_t item_flags)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, len, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    memcpy((uint8_t*)slab.buffer + fullname_len, buff, len);
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope)) | item_flags;
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, len, &op.params[2]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_VR, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+uint32_t comsst_client_data_verify(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_client_verify(client, scope, name, is_deletable, buff, len,
+        0);
+}
+
+uint32_t comsst_client_data_verify_digest(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t digest[COMSST_DIGEST_LEN])
+{
+    return comsst_client_verify(client, scope, name, is_deletable, digest,
+        COMSST_DIGEST_LEN, COMSST_ITEM_DIGEST);
+}
+
+uint32_t comsst_client_data_digest(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t digest[COMSST_DIGEST_LEN])
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
     uint32_t fullname_len;
 
-    fullname_len = strlen((char*)scope) + strlen((char*)name);
+    res = comsst_client_prepare(client, scope, name, COMSST_DIGEST_LEN,
+        &slab, &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, COMSST_DIGEST_LEN, &op.params[2]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_DIGEST, &op);
+    if (res == TEEC_SUCCESS) {
+        memcpy(digest, (uint8_t*)slab.buffer + fullname_len,
+            COMSST_DIGEST_LEN);
+    }
+
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+/* The bytes stored are only asked for if stored is not NULL */
+
+static TEEC_Result comsst_client_stat(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t* size,
+    uint32_t* flags, uint32_t* stored, uint32_t* objects)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, 0, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_VALUE_OUTPUT,
+        stored != NULL || objects != NULL ? TEEC_VALUE_OUTPUT : TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_STAT, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    if (size != NULL) {
+        *size = op.params[2].value.a;
+    }
+
+    if (flags != NULL) {
+        *flags = op.params[2].value.b;
+    }
+
+    if (stored != NULL) {
+        *stored = op.params[3].value.a;
+    }
+
+    if (objects != NULL) {
+        *objects = op.params[3].value.b;
+    }
+
+    return TEEC_SUCCESS;
+}
+
+uint32_t comsst_client_data_stat(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t* size, uint32_t* flags)
+{
+    return comsst_client_stat(client, scope, name, is_deletable, size, flags,
+        NULL, NULL);
+}
+
+uint32_t comsst_client_data_stored_size(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t* stored)
+{
+    return comsst_client_stat(client, scope, name, is_deletable, NULL, NULL,
+        stored, NULL);
+}
+
+uint32_t comsst_client_data_footprint(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t* stored,
+    uint32_t* objects)
+{
+    return comsst_client_stat(client, scope, name, is_deletable, NULL, NULL,
+        stored, objects);
+}
+
+/*
+ * The expected data, or its digest, follows the new data in the slab. The
+ * cached copy of the item is dropped whatever the outcome, a conflict
+ * means it is stale anyway.
+ */
+
+static TEEC_Result comsst_client_cas(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t* expected, uint32_t expected_len, uint8_t* buff,
+    uint32_t len, uint32_t item_flags)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    if (expected == NULL) {
+        expected_len = 0;
+        item_flags = COMSST_ITEM_ABSENT;
+    }
+
+    if (expected_len > UINT32_MAX - len) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    res = comsst_client_prepare(client, scope, name, len + expected_len,
+        &slab, &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    memcpy((uint8_t*)slab.buffer + fullname_len, buff, len);
+    if (expected_len > 0) {
+        memcpy((uint8_t*)slab.buffer + fullname_len + len, expected,
+            expected_len);
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope)) | item_flags;
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, len, &op.params[2]);
+    comsst_memref_at(&slab, fullname_len + len, expected_len, &op.params[3]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_CAS, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
+
+uint32_t comsst_client_data_cas(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, const uint8_t* expected,
+    uint32_t expected_len, uint8_t* buff, uint32_t len)
+{
+    return comsst_client_cas(client, scope, name, is_deletable, expected,
+        expected_len, buff, len, 0);
+}
+
+uint32_t comsst_client_data_cas_digest(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t expected[COMSST_DIGEST_LEN], uint8_t* buff, uint32_t len)
+{
+    return comsst_client_cas(client, scope, name, is_deletable, expected,
+        COMSST_DIGEST_LEN, buff, len, COMSST_ITEM_DIGEST);
+}
+
+static TEEC_Result comsst_client_txn(comsst_client_t* client,
+    uint32_t cmd_id)
+{
+    TEEC_Operation op;
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE, TEEC_NONE,
+        TEEC_NONE);
+    return comsst_client_invoke(client, cmd_id, &op);
+}
+
+static TEEC_Result comsst_client_txn_stage(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len, uint32_t item_flags)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    res = comsst_client_prepare(client, scope, name, len, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    if (len > 0) {
+        memcpy((uint8_t*)slab.buffer + fullname_len, buff, len);
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope)) | item_flags;
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, len, &op.params[2]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_TXN_STAGE, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+uint32_t comsst_client_txn_begin(comsst_client_t* client)
+{
+    return comsst_client_txn(client, TA_COMSST_CMD_TXN_BEGIN);
+}
+
+uint32_t comsst_client_txn_write(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_client_txn_stage(client, scope, name, is_deletable, buff,
+        len, 0);
+}
+
+uint32_t comsst_client_txn_delete(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    return comsst_client_txn_stage(client, scope, name, is_deletable, NULL,
+        0, COMSST_ITEM_REMOVE);
+}
+
+/*
+ * Whatever the result, the cached copies of the items staged may be stale.
+ * They are not tracked here, so the whole cache goes.
+ */
+
+uint32_t comsst_client_txn_commit(comsst_client_t* client)
+{
+    TEEC_Result res;
+
+    res = comsst_client_txn(client, TA_COMSST_CMD_TXN_COMMIT);
+    comsst_cache_flush();
+    return res;
+}
+
+uint32_t comsst_client_txn_abort(comsst_client_t* client)
+{
+    return comsst_client_txn(client, TA_COMSST_CMD_TXN_ABORT);
+}
+
+uint32_t comsst_client_data_read_alloc(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t** buff,
+    uint32_t* out_len)
+{
+    TEEC_Result res;
+    uint8_t* data;
+    uint32_t size;
+
+    if (buff == NULL || out_len == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    res = comsst_client_data_stat(client, scope, name, is_deletable, &size,
+        NULL);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    data = malloc(size ? size : 1);
+    if (data == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    /*
+     * If the item grew after the stat, TEEC_ERROR_SHORT_BUFFER is passed
+     * on together with the new size
+     */
+
+    *out_len = size;
+    res = comsst_client_data_read(client, scope, name, is_deletable, data,
+        out_len);
+    if (res != TEEC_SUCCESS) {
+        free(data);
+        return res;
+    }
+
+    *buff = data;
+    return TEEC_SUCCESS;
+}
+
+/*
+ * Register the buffer of the caller as shared memory, so the TA reads or
+ * writes it directly. Not every TEE driver can map any user buffer, the
+ * callers fall back to copying through the pool if this fails.
+ */
+
+static TEEC_Result comsst_client_register(comsst_client_t* client,
+    void* buff, uint32_t len, uint32_t flags, TEEC_SharedMemory* shm)
+{
+    TEEC_Result res;
+
+    if (buff == NULL || len == 0) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    memset(shm, 0, sizeof(*shm));
+    shm->buffer = buff;
+    shm->size = len;
+    shm->flags = flags;
+
+    DMSG("TEEC_RegisterSharedMemory...\n");
+    res = TEEC_RegisterSharedMemory(&client->ctx, shm);
+    if (res != TEEC_SUCCESS) {
+        DMSG("TEEC_RegisterSharedMemory failed with code 0x%08lx\n", res);
+    }
+
+    return res;
+}
+
+uint32_t comsst_client_data_read_direct(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t* out_len)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    TEEC_SharedMemory data_shm;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    if (comsst_cache_lookup(scope, name, is_deletable, buff, out_len, &res)) {
+        return res;
+    }
+
+    if (comsst_client_register(client, buff, *out_len, TEEC_MEM_OUTPUT,
+            &data_shm)
+        != TEEC_SUCCESS) {
+        return comsst_client_read_tee(client, scope, name, is_deletable,
+            buff, out_len);
+    }
+
+    res = comsst_client_prepare(client, scope, name, 0, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        goto out_release;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_WHOLE, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    op.params[2].memref.parent = &data_shm;
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_RD, &op);
+    if (res != TEEC_SUCCESS) {
+        goto out;
+    }
+
+    if (op.params[0].value.b > *out_len) {
+        res = TEEC_ERROR_SHORT_BUFFER;
+    }
+
+    *out_len = op.params[0].value.b;
+
+out:
+    tee_shm_pool_free(&client->pool, &slab);
+out_release:
+    DMSG("TEEC_ReleaseSharedMemory...\n");
+    TEEC_ReleaseSharedMemory(&data_shm);
+    return res;
+}
+
+uint32_t comsst_client_data_write_direct(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    TEEC_SharedMemory data_shm;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+
+    if (comsst_client_register(client, buff, len, TEEC_MEM_INPUT, &data_shm)
+        != TEEC_SUCCESS) {
+        return comsst_client_data_write(client, scope, name, is_deletable,
+            buff, len);
+    }
+
+    res = comsst_client_prepare(client, scope, name, 0, &slab,
+        &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        goto out_release;
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_WHOLE, TEEC_NONE);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    op.params[2].memref.parent = &data_shm;
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_WR, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+out_release:
+    DMSG("TEEC_ReleaseSharedMemory...\n");
+    TEEC_ReleaseSharedMemory(&data_shm);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
+
+struct comsst_batch_entry {
+    uint32_t cmd;
+    uint8_t fullname[MAX_LEN_OF_FULLNAME];
+    uint32_t fullname_len;
+    bool is_deletable;
+    uint32_t scope_len;
+    uint8_t* buff;
+    uint32_t len;
+    uint32_t status;
+    uint32_t out_len;
+};
+
+struct comsst_batch {
+    struct comsst_batch_entry* ops;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+uint32_t comsst_batch_create(comsst_batch_t** batch)
+{
+    if (batch == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    *batch = calloc(1, sizeof(**batch));
+    if (*batch == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    return TEEC_SUCCESS;
+}
+
+void comsst_batch_destroy(comsst_batch_t* batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+
+    free(batch->ops);
+    free(batch);
+}
+
+static uint32_t comsst_batch_add(comsst_batch_t* batch, uint32_t cmd,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len)
+{
+    struct comsst_batch_entry* e;
+    size_t scope_len = strlen((char*)scope);
+    size_t name_len = strlen((char*)name);
+
+    if (scope_len + name_len > MAX_LEN_OF_FULLNAME) {
+        EMSG("Length of scope and name is too long\n");
+        return TEEC_ERROR_GENERIC;
+    }
+
+    if (batch->count == batch->capacity) {
+        uint32_t capacity = batch->capacity ? batch->capacity * 2 : 8;
+
+        e = realloc(batch->ops, capacity * sizeof(*e));
+        if (e == NULL) {
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        }
+
+        batch->ops = e;
+        batch->capacity = capacity;
+    }
+
+    e = &batch->ops[batch->count++];
+    e->cmd = cmd;
+    memcpy(e->fullname, scope, scope_len);
+    memcpy(e->fullname + scope_len, name, name_len);
+    e->fullname_len = scope_len + name_len;
+    e->is_deletable = is_deletable;
+    e->scope_len = scope_len;
+    e->buff = buff;
+    e->len = buff != NULL ? len : 0;
+    e->status = TEEC_ERROR_BAD_STATE;
+    e->out_len = 0;
+    return TEEC_SUCCESS;
+}
+
+uint32_t comsst_batch_add_read(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_batch_add(batch, TA_COMSST_CMD_RD, scope, name,
+        is_deletable, buff, len);
+}
+
+uint32_t comsst_batch_add_write(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_batch_add(batch, TA_COMSST_CMD_WR, scope, name,
+        is_deletable, buff, len);
+}
+
+uint32_t comsst_batch_add_delete(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    return comsst_batch_add(batch, TA_COMSST_CMD_DEL, scope, name,
+        is_deletable, NULL, 0);
+}
+
+uint32_t comsst_batch_add_check(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable)
+{
+    return comsst_batch_add(batch, TA_COMSST_CMD_CHK, scope, name,
+        is_deletable, NULL, 0);
+}
+
+uint32_t comsst_batch_add_verify(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    return comsst_batch_add(batch, TA_COMSST_CMD_VR, scope, name,
+        is_deletable, buff, len);
+}
+
+uint32_t comsst_batch_get_result(comsst_batch_t* batch, uint32_t index,
+    uint32_t* out_len)
+{
+    if (batch == NULL || index >= batch->count) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    if (out_len != NULL) {
+        *out_len = batch->ops[index].out_len;
+    }
+
+    return batch->ops[index].status;
+}
+
+static size_t comsst_batch_rec_len(const struct comsst_batch_entry* e)
+{
+    return COMSST_BATCH_ALIGN(sizeof(struct comsst_batch_op)
+        + e->fullname_len + e->len);
+}
+
+uint32_t comsst_client_batch_run(comsst_client_t* client,
+    comsst_batch_t* batch, bool stop_on_error)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    struct comsst_batch_op hdr;
+    struct comsst_batch_entry* e;
+    uint8_t* rec;
+    size_t size = 0;
+    uint32_t i;
+
+    if (batch == NULL || batch->count == 0) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    for (i = 0; i < batch->count; i++) {
+        batch->ops[i].status = TEEC_ERROR_BAD_STATE;
+        batch->ops[i].out_len = 0;
+        size += comsst_batch_rec_len(&batch->ops[i]);
+    }
+
+    res = tee_shm_pool_alloc(&client->pool, size, &slab);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    rec = slab.buffer;
+    for (i = 0; i < batch->count; i++) {
+        e = &batch->ops[i];
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.cmd = e->cmd;
+        hdr.is_deletable = COMSST_ITEM_FLAGS(e->is_deletable, e->scope_len);
+        hdr.name_len = e->fullname_len;
+        hdr.data_len = e->len;
+        memcpy(rec, &hdr, sizeof(hdr));
+        memcpy(rec + sizeof(hdr), e->fullname, e->fullname_len);
+        if (e->cmd != TA_COMSST_CMD_RD && e->len != 0) {
+            memcpy(rec + sizeof(hdr) + e->fullname_len, e->buff, e->len);
+        }
+
+        rec += comsst_batch_rec_len(e);
+    }
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT,
+        TEEC_MEMREF_PARTIAL_INOUT, TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = batch->count;
+    op.params[0].value.b = stop_on_error ? COMSST_BATCH_STOP_ON_ERROR : 0;
+    tee_shm_pool_memref(&slab, size, &op.params[1]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_BATCH, &op);
+    if (res != TEEC_SUCCESS) {
+        goto out;
+    }
+
+    rec = slab.buffer;
+    for (i = 0; i < op.params[0].value.a && i < batch->count; i++) {
+        e = &batch->ops[i];
+        memcpy(&hdr, rec, sizeof(hdr));
+        e->status = hdr.status;
+        e->out_len = hdr.out_len;
+
+        if (e->cmd == TA_COMSST_CMD_RD && e->status == TEEC_SUCCESS) {
+            if (e->out_len > e->len) {
+                e->status = TEEC_ERROR_SHORT_BUFFER;
+            } else {
+                memcpy(e->buff, rec + sizeof(hdr) + e->fullname_len,
+                    e->out_len);
+            }
+        }
+
+        rec += comsst_batch_rec_len(e);
+    }
+
+out:
+    tee_shm_pool_free(&client->pool, &slab);
+
+    /* The writes and deletes may have run even if the invoke failed */
+
+    for (i = 0; i < batch->count; i++) {
+        e = &batch->ops[i];
+        if (e->cmd == TA_COMSST_CMD_WR || e->cmd == TA_COMSST_CMD_DEL) {
+            comsst_cache_invalidate(e->fullname, e->fullname_len,
+                e->is_deletable);
+        }
+    }
+
+    return res;
+}
+
+uint32_t comsst_client_list(comsst_client_t* client, uint8_t* scope,
+    bool is_deletable, uint32_t* cursor, comsst_list_cb_t cb, void* priv)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    size_t scope_len = strlen((char*)scope);
+    uint8_t* page;
+    size_t used;
+    size_t pos;
+
+    if (cursor == NULL || cb == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    /* The scope is followed by the page the names are returned in */
+
+    res = tee_shm_pool_alloc(&client->pool,
+        scope_len + CONFIG_CA_COMSST_LIST_PAGE_SIZE, &slab);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    memcpy(slab.buffer, scope, scope_len);
+    page = (uint8_t*)slab.buffer + scope_len;
+
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+        TEEC_VALUE_INOUT);
+    op.params[0].value.a = scope_len;
+    op.params[0].value.b = is_deletable ? 1 : 0;
+    tee_shm_pool_memref(&slab, scope_len, &op.params[1]);
+    comsst_memref_at(&slab, scope_len, CONFIG_CA_COMSST_LIST_PAGE_SIZE,
+        &op.params[2]);
+    op.params[3].value.a = *cursor;
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_LIST, &op);
+    if (res != TEEC_SUCCESS) {
+        goto out;
+    }
+
+    used = op.params[2].memref.size;
+    for (pos = 0; pos < used && pos + 1 + page[pos] <= used;
+         pos += 1 + page[pos]) {
+        cb(page + pos + 1, page[pos], priv);
+    }
+
+    *cursor = op.params[3].value.a;
+
+out:
+    tee_shm_pool_free(&client->pool, &slab);
+    return res;
+}
+
+uint32_t comsst_client_scope_clear(comsst_client_t* client, uint8_t* scope,
+    bool is_deletable, uint32_t* count)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    size_t scope_len = strlen((char*)scope);
+
+    if (scope_len == 0 || scope_len > MAX_LEN_OF_FULLNAME) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
 
-    if (fullname_len > MAX_LEN_OF_FULLNAME) {
-        EMSG("Length of scope and name is too long\n");
-        goto exit;
+    res = tee_shm_pool_alloc(&client->pool, scope_len, &slab);
+    if (res != TEEC_SUCCESS) {
+        return res;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    memcpy(slab.buffer, scope, scope_len);
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    /* Clear the TEEC_Operation struct */
 
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+    op.params[0].value.a = scope_len;
+    op.params[0].value.b = is_deletable ? 1 : 0;
+    tee_shm_pool_memref(&slab, scope_len, &op.params[1]);
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_DEL_SCOPE, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_invalidate_prefix(scope, scope_len, is_deletable);
+
+    /* Some items may have been deleted even if it failed half way */
+
+    if (count != NULL) {
+        *count = op.params[2].value.a;
     }
 
+    return res;
+}
+
+/*
+ * Read or write one window at offset, the full name is at the head of the
+ * slab and the window follows it
+ */
+
+static TEEC_Result comsst_client_chunk(comsst_client_t* client,
+    uint32_t cmd, struct tee_shm_slab* slab, uint32_t fullname_len,
+    uint32_t item_flags, uint32_t offset, uint32_t flags, uint32_t* len,
+    uint32_t* total)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = *out_len + fullname_len;
-    io_shm.flags = TEEC_MEM_OUTPUT | TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT,
+        cmd == TA_COMSST_CMD_RD_CHUNK ? TEEC_MEMREF_PARTIAL_OUTPUT
+                                      : TEEC_MEMREF_PARTIAL_INPUT,
+        TEEC_VALUE_INOUT);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = item_flags;
+    tee_shm_pool_memref(slab, fullname_len, &op.params[1]);
+    comsst_memref_at(slab, fullname_len, *len, &op.params[2]);
+    op.params[3].value.a = offset;
+    op.params[3].value.b = flags;
+
+    res = comsst_client_invoke(client, cmd, &op);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
-    strcpy(io_shm.buffer, (char*)scope);
-    strcat(io_shm.buffer, (char*)name);
+    if (cmd == TA_COMSST_CMD_RD_CHUNK) {
+        *len = op.params[2].memref.size;
+    }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+    if (total != NULL) {
+        *total = op.params[3].value.b;
+    }
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    return TEEC_SUCCESS;
+}
+
+uint32_t comsst_client_data_read_at(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t offset, uint8_t* buff,
+    uint32_t* len, uint32_t* total)
+{
+    TEEC_Result res;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+    uint32_t item_flags = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    uint32_t done = 0;
+    uint32_t chunk;
+    uint32_t want;
+
+    res = comsst_client_prepare(client, scope, name,
+        CONFIG_CA_COMSST_STREAM_WINDOW, &slab, &fullname_len);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = fullname_len;
-    op.params[0].value.b = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    do {
+        want = *len - done < CONFIG_CA_COMSST_STREAM_WINDOW
+            ? *len - done
+            : CONFIG_CA_COMSST_STREAM_WINDOW;
+        chunk = want;
+        res = comsst_client_chunk(client, TA_COMSST_CMD_RD_CHUNK, &slab,
+            fullname_len, item_flags, offset + done, 0, &chunk, total);
+        if (res != TEEC_SUCCESS) {
+            break;
+        }
+
+        memcpy(buff + done, (uint8_t*)slab.buffer + fullname_len, chunk);
+        done += chunk;
+    } while (chunk == want && done < *len);
+
+    tee_shm_pool_free(&client->pool, &slab);
+    *len = done;
+    return res;
+}
+
+uint32_t comsst_client_data_write_at(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t offset,
+    uint8_t* buff, uint32_t len, bool create)
+{
+    TEEC_Result res;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+    uint32_t item_flags = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    uint32_t done = 0;
+    uint32_t chunk;
 
-    res = TEEC_InvokeCommand(&sess, TA_COMSST_CMD_RD, &op, &err_origin);
+    res = comsst_client_prepare(client, scope, name,
+        CONFIG_CA_COMSST_STREAM_WINDOW, &slab, &fullname_len);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-    *out_len = op.params[0].value.b;
+    do {
+        chunk = len - done < CONFIG_CA_COMSST_STREAM_WINDOW
+            ? len - done
+            : CONFIG_CA_COMSST_STREAM_WINDOW;
+        memcpy((uint8_t*)slab.buffer + fullname_len, buff + done, chunk);
+        res = comsst_client_chunk(client, TA_COMSST_CMD_WR_CHUNK, &slab,
+            fullname_len, item_flags, offset + done,
+            done == 0 && create ? COMSST_CHUNK_CREATE : 0, &chunk, NULL);
+        if (res != TEEC_SUCCESS) {
+            break;
+        }
+
+        done += chunk;
+    } while (done < len);
+
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
 
-    memcpy(buff, io_shm.buffer, *out_len);
+uint32_t comsst_client_data_read_stream(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    comsst_stream_sink_t sink, void* priv)
+{
+    TEEC_Result res;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
+    uint32_t item_flags = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    uint32_t offset = 0;
+    uint32_t total;
+    uint32_t chunk;
+
+    if (sink == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = comsst_client_prepare(client, scope, name,
+        CONFIG_CA_COMSST_STREAM_WINDOW, &slab, &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
+
+    do {
+        chunk = CONFIG_CA_COMSST_STREAM_WINDOW;
+        res = comsst_client_chunk(client, TA_COMSST_CMD_RD_CHUNK, &slab,
+            fullname_len, item_flags, offset, 0, &chunk, &total);
+        if (res != TEEC_SUCCESS) {
+            break;
+        }
+
+        if (chunk > 0
+            && sink((uint8_t*)slab.buffer + fullname_len, chunk, priv) != 0) {
+            res = TEEC_ERROR_CANCEL;
+            break;
+        }
+
+        offset += chunk;
+    } while (chunk > 0 && offset < total);
+
+    tee_shm_pool_free(&client->pool, &slab);
     return res;
 }
 
-uint32_t comsst_data_write(uint8_t* scope, uint8_t* name, bool is_deletable,
-    uint8_t* buff, uint32_t len)
+uint32_t comsst_client_data_write_stream(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    comsst_stream_source_t source, void* priv)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_COMSST_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    TEEC_Result res;
+    struct tee_shm_slab slab;
     uint32_t fullname_len;
+    uint32_t item_flags = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    uint32_t offset = 0;
+    uint32_t chunk;
+    int32_t ret;
+
+    if (source == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
 
-    fullname_len = strlen((char*)scope) + strlen((char*)name);
-
-    if (fullname_len > MAX_LEN_OF_FULLNAME) {
-        EMSG("Length of scope and name is too long\n");
-        goto exit;
+    res = comsst_client_prepare(client, scope, name,
+        CONFIG_CA_COMSST_STREAM_WINDOW, &slab, &fullname_len);
+    if (res != TEEC_SUCCESS) {
+        return res;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    /* The first window creates the item, even if the source is empty */
+
+    do {
+        ret = source((uint8_t*)slab.buffer + fullname_len,
+            CONFIG_CA_COMSST_STREAM_WINDOW, priv);
+        if (ret < 0 || ret > CONFIG_CA_COMSST_STREAM_WINDOW) {
+            res = TEEC_ERROR_CANCEL;
+            break;
+        }
+
+        if (ret == 0 && offset > 0) {
+            break;
+        }
+
+        chunk = ret;
+        res = comsst_client_chunk(client, TA_COMSST_CMD_WR_CHUNK, &slab,
+            fullname_len, item_flags, offset,
+            offset == 0 ? COMSST_CHUNK_CREATE : 0, &chunk, NULL);
+        offset += chunk;
+    } while (res == TEEC_SUCCESS && ret > 0);
+
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+uint32_t comsst_client_data_patch(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t offset, uint8_t* buff,
+    uint32_t len, bool truncate)
+{
+    TEEC_Result res;
+    TEEC_Operation op;
+    struct tee_shm_slab slab;
+    uint32_t fullname_len;
 
+    res = comsst_client_prepare(client, scope, name, len, &slab,
+        &fullname_len);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
+    }
+
+    if (len > 0) {
+        memcpy((uint8_t*)slab.buffer + fullname_len, buff, len);
     }
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = len + fullname_len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
-    }
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+        TEEC_VALUE_INOUT);
+    op.params[0].value.a = fullname_len;
+    op.params[0].value.b = COMSST_ITEM_FLAGS(is_deletable,
+        strlen((char*)scope));
+    tee_shm_pool_memref(&slab, fullname_len, &op.params[1]);
+    comsst_memref_at(&slab, fullname_len, len, &op.params[2]);
+    op.params[3].value.a = offset;
+    op.params[3].value.b = truncate ? offset + len : COMSST_PATCH_KEEP_SIZE;
+
+    res = comsst_client_invoke(client, TA_COMSST_CMD_PATCH, &op);
+    tee_shm_pool_free(&client->pool, &slab);
+    comsst_cache_drop(scope, name, is_deletable);
+    return res;
+}
 
-    strcpy(io_shm.buffer, (char*)scope);
-    strcat(io_shm.buffer, (char*)name);
+uint32_t comsst_data_read_ex(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t* out_len, uint32_t flags)
+{
+    comsst_client_t* client;
+    uint32_t res;
+    uint32_t gen;
 
-    memcpy(io_shm.buffer + fullname_len, buff, len);
+    /* A hit does not need a session at all */
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+    if (comsst_cache_lookup(scope, name, is_deletable, buff, out_len, &res)) {
+        return res;
+    }
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = fullname_len;
-    op.params[0].value.b = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    gen = comsst_cache_generation();
+    res = comsst_client_read_tee(client, scope, name, is_deletable, buff,
+        out_len);
+    if (res == TEEC_SUCCESS && (flags & COMSST_FLAG_CACHEABLE)) {
+        comsst_cache_fill(scope, name, is_deletable, buff, *out_len, gen);
+    }
+
+    comsst_client_close(client);
+    return res;
+}
+
+uint32_t comsst_data_read(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t* buff, uint32_t* out_len)
+{
+    return comsst_data_read_ex(scope, name, is_deletable, buff, out_len, 0);
+}
+
+uint32_t comsst_data_write_ex(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, uint32_t flags)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    res = TEEC_InvokeCommand(&sess, TA_COMSST_CMD_WR, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = comsst_client_data_write_ex(client, scope, name, is_deletable,
+        buff, len, flags);
+    comsst_client_close(client);
     return res;
 }
 
+uint32_t comsst_data_write(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t* buff, uint32_t len)
+{
+    return comsst_data_write_ex(scope, name, is_deletable, buff, len, 0);
+}
+
 uint32_t comsst_data_delete(uint8_t* scope, uint8_t* name, bool is_deletable)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_COMSST_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
-    uint32_t fullname_len;
+    comsst_client_t* client;
+    uint32_t res;
+
+    res = comsst_client_open(&client);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
 
-    fullname_len = strlen((char*)scope) + strlen((char*)name);
+    res = comsst_client_data_delete(client, scope, name, is_deletable);
+    comsst_client_close(client);
+    return res;
+}
 
-    if (fullname_len > MAX_LEN_OF_FULLNAME) {
-        EMSG("Length of scope and name is too long\n");
-        goto exit;
+uint32_t is_comsst_data_exited(uint8_t* scope, uint8_t* name,
+    bool is_deletable)
+{
+    comsst_client_t* client;
+    uint32_t res;
+
+    if (comsst_client_open(&client) != TEEC_SUCCESS) {
+        return false;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    res = comsst_client_data_check(client, scope, name, is_deletable);
+    comsst_client_close(client);
+    return res;
+}
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+uint32_t comsst_data_verify(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t* buff, uint32_t len)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
     }
 
-    /* Clear the TEEC_Operation struct */
+    res = comsst_client_data_verify(client, scope, name, is_deletable, buff,
+        len);
+    comsst_client_close(client);
+    return res;
+}
 
-    memset(&op, 0, sizeof(op));
+uint32_t comsst_data_verify_digest(uint8_t* scope, uint8_t* name,
+    bool is_deletable, const uint8_t digest[COMSST_DIGEST_LEN])
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    io_shm.size = fullname_len + 1;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
-    strcpy(io_shm.buffer, (char*)scope);
-    strcat(io_shm.buffer, (char*)name);
+    res = comsst_client_data_verify_digest(client, scope, name, is_deletable,
+        digest);
+    comsst_client_close(client);
+    return res;
+}
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+uint32_t comsst_data_digest(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t digest[COMSST_DIGEST_LEN])
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = fullname_len;
-    op.params[0].value.b = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    res = comsst_client_data_digest(client, scope, name, is_deletable,
+        digest);
+    comsst_client_close(client);
+    return res;
+}
+
+uint32_t comsst_data_cas(uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t* expected, uint32_t expected_len, uint8_t* buff,
+    uint32_t len)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    res = TEEC_InvokeCommand(&sess, TA_COMSST_CMD_DEL, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = comsst_client_data_cas(client, scope, name, is_deletable, expected,
+        expected_len, buff, len);
+    comsst_client_close(client);
     return res;
 }
 
-uint32_t is_comsst_data_exited(uint8_t* scope, uint8_t* name,
-    bool is_deletable)
+uint32_t comsst_data_cas_digest(uint8_t* scope, uint8_t* name,
+    bool is_deletable, const uint8_t expected[COMSST_DIGEST_LEN],
+    uint8_t* buff, uint32_t len)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_COMSST_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
-    uint32_t fullname_len;
-
-    fullname_len = strlen((char*)scope) + strlen((char*)name);
+    comsst_client_t* client;
+    uint32_t res;
 
-    if (fullname_len > MAX_LEN_OF_FULLNAME) {
-        EMSG("Length of scope and name is too long\n");
-        goto exit;
+    res = comsst_client_open(&client);
+    if (res != TEEC_SUCCESS) {
+        return res;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    res = comsst_client_data_cas_digest(client, scope, name, is_deletable,
+        expected, buff, len);
+    comsst_client_close(client);
+    return res;
+}
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+uint32_t comsst_data_read_direct(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t* out_len)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
     }
 
-    /* Clear the TEEC_Operation struct */
+    res = comsst_client_data_read_direct(client, scope, name, is_deletable,
+        buff, out_len);
+    comsst_client_close(client);
+    return res;
+}
 
-    memset(&op, 0, sizeof(op));
+uint32_t comsst_data_write_direct(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    io_shm.size = fullname_len + 1;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
-    strcpy(io_shm.buffer, (char*)scope);
-    strcat(io_shm.buffer, (char*)name);
+    res = comsst_client_data_write_direct(client, scope, name, is_deletable,
+        buff, len);
+    comsst_client_close(client);
+    return res;
+}
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+uint32_t comsst_data_stat(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint32_t* size, uint32_t* flags)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = fullname_len;
-    op.params[0].value.b = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    res = comsst_client_data_stat(client, scope, name, is_deletable, size,
+        flags);
+    comsst_client_close(client);
+    return res;
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_COMSST_CMD_CHK, &op, &err_origin);
+uint32_t comsst_data_read_alloc(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t** buff, uint32_t* out_len)
+{
+    comsst_client_t* client;
+    uint32_t res;
+
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
-    if (res != TEEC_SUCCESS)
-        return false;
-    else
-        return true;
+    res = comsst_client_data_read_alloc(client, scope, name, is_deletable,
+        buff, out_len);
+    comsst_client_close(client);
+    return res;
 }
 
-uint32_t comsst_data_verify(uint8_t* scope, uint8_t* name, bool is_deletable,
-    uint8_t* buff, uint32_t len)
+uint32_t comsst_batch_run(comsst_batch_t* batch, bool stop_on_error)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_COMSST_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
-    uint32_t fullname_len;
-
-    fullname_len = strlen((char*)scope) + strlen((char*)name);
+    comsst_client_t* client;
+    uint32_t res;
 
-    if (fullname_len > MAX_LEN_OF_FULLNAME) {
-        EMSG("Length of scope and name is too long\n");
-        goto exit;
+    res = comsst_client_open(&client);
+    if (res != TEEC_SUCCESS) {
+        return res;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    res = comsst_client_batch_run(client, batch, stop_on_error);
+    comsst_client_close(client);
+    return res;
+}
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+uint32_t comsst_list(uint8_t* scope, bool is_deletable, comsst_list_cb_t cb,
+    void* priv)
+{
+    comsst_client_t* client;
+    uint32_t cursor = 0;
+    uint32_t res;
 
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
     }
 
-    /* Clear the TEEC_Operation struct */
+    do {
+        res = comsst_client_list(client, scope, is_deletable, &cursor, cb,
+            priv);
+    } while (res == TEEC_SUCCESS && cursor != 0);
 
-    memset(&op, 0, sizeof(op));
+    comsst_client_close(client);
+    return res;
+}
 
-    io_shm.size = len + fullname_len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+uint32_t comsst_scope_clear(uint8_t* scope, bool is_deletable,
+    uint32_t* count)
+{
+    comsst_client_t* client;
+    uint32_t res;
+
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
-    strcpy(io_shm.buffer, (char*)scope);
-    strcat(io_shm.buffer, (char*)name);
+    res = comsst_client_scope_clear(client, scope, is_deletable, count);
+    comsst_client_close(client);
+    return res;
+}
 
-    memcpy(io_shm.buffer + fullname_len, buff, len);
+uint32_t comsst_data_read_stream(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_stream_sink_t sink, void* priv)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+    res = comsst_client_open(&client);
+    if (res != TEEC_SUCCESS) {
+        return res;
+    }
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    res = comsst_client_data_read_stream(client, scope, name, is_deletable,
+        sink, priv);
+    comsst_client_close(client);
+    return res;
+}
+
+uint32_t comsst_data_write_stream(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_stream_source_t source, void* priv)
+{
+    comsst_client_t* client;
+    uint32_t res;
+
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = fullname_len;
-    op.params[0].value.b = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    res = comsst_client_data_write_stream(client, scope, name, is_deletable,
+        source, priv);
+    comsst_client_close(client);
+    return res;
+}
+
+uint32_t comsst_data_patch(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint32_t offset, uint8_t* buff, uint32_t len, bool truncate)
+{
+    comsst_client_t* client;
+    uint32_t res;
 
-    res = TEEC_InvokeCommand(&sess, TA_COMSST_CMD_VR, &op, &err_origin);
+    res = comsst_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = comsst_client_data_patch(client, scope, name, is_deletable, offset,
+        buff, len, truncate);
+    comsst_client_close(client);
     return res;
-}
\ No newline at end of file
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nuttx/config.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <teec_trace.h>
+
+#include "comsst_cache.h"
+
+/* Items with a longer "scope + name" are never cached */
+
+#define COMSST_CACHE_KEY_MAX (32)
+
+struct comsst_cache_entry {
+    struct comsst_cache_entry* prev;
+    struct comsst_cache_entry* next;
+    uint8_t key[COMSST_CACHE_KEY_MAX];
+    uint32_t key_len;
+    bool is_deletable;
+    uint32_t len;
+    uint8_t data[];
+};
+
+/*
+ * The entries are kept from the most to the least recently used.
+ * generation changes with every put and invalidation, so that a put of
+ * data read from the TEE before one of them can be told apart, see
+ * comsst_cache_put().
+ */
+
+static struct {
+    pthread_mutex_t lock;
+    struct comsst_cache_entry* head;
+    struct comsst_cache_entry* tail;
+    size_t used;
+    uint32_t generation;
+    struct comsst_cache_stats stats;
+} g_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static size_t entry_cost(uint32_t len)
+{
+    return sizeof(struct comsst_cache_entry) + len;
+}
+
+static void entry_unlink(struct comsst_cache_entry* e)
+{
+    if (e->prev != NULL) {
+        e->prev->next = e->next;
+    } else {
+        g_cache.head = e->next;
+    }
+
+    if (e->next != NULL) {
+        e->next->prev = e->prev;
+    } else {
+        g_cache.tail = e->prev;
+    }
+
+    e->prev = NULL;
+    e->next = NULL;
+}
+
+static void entry_push_front(struct comsst_cache_entry* e)
+{
+    e->prev = NULL;
+    e->next = g_cache.head;
+    if (g_cache.head != NULL) {
+        g_cache.head->prev = e;
+    } else {
+        g_cache.tail = e;
+    }
+
+    g_cache.head = e;
+}
+
+static void entry_free(struct comsst_cache_entry* e)
+{
+    entry_unlink(e);
+    g_cache.used -= entry_cost(e->len);
+    g_cache.stats.entries--;
+    g_cache.stats.bytes -= e->len;
+    free(e);
+}
+
+static struct comsst_cache_entry* entry_find(const uint8_t* key,
+    uint32_t key_len, bool is_deletable)
+{
+    struct comsst_cache_entry* e;
+
+    for (e = g_cache.head; e != NULL; e = e->next) {
+        if (e->is_deletable == is_deletable && e->key_len == key_len
+            && memcmp(e->key, key, key_len) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+bool comsst_cache_get(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable, uint8_t* buff, uint32_t* len, TEEC_Result* res)
+{
+    struct comsst_cache_entry* e;
+
+    if (CONFIG_CA_COMSST_CACHE_SIZE == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&g_cache.lock);
+    e = entry_find(fullname, fullname_len, is_deletable);
+    if (e == NULL) {
+        g_cache.stats.misses++;
+        pthread_mutex_unlock(&g_cache.lock);
+        return false;
+    }
+
+    g_cache.stats.hits++;
+    entry_unlink(e);
+    entry_push_front(e);
+
+    if (e->len > *len) {
+        *res = TEEC_ERROR_SHORT_BUFFER;
+    } else {
+        memcpy(buff, e->data, e->len);
+        *res = TEEC_SUCCESS;
+    }
+
+    *len = e->len;
+    pthread_mutex_unlock(&g_cache.lock);
+    return true;
+}
+
+uint32_t comsst_cache_generation(void)
+{
+    uint32_t gen;
+
+    pthread_mutex_lock(&g_cache.lock);
+    gen = g_cache.generation;
+    pthread_mutex_unlock(&g_cache.lock);
+    return gen;
+}
+
+void comsst_cache_put(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable, const uint8_t* data, uint32_t len, uint32_t gen)
+{
+    struct comsst_cache_entry* e;
+
+    if (CONFIG_CA_COMSST_CACHE_SIZE == 0
+        || fullname_len > COMSST_CACHE_KEY_MAX) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_cache.lock);
+    e = entry_find(fullname, fullname_len, is_deletable);
+    if (e != NULL) {
+        entry_free(e);
+    }
+
+    /*
+     * Another thread changed the cache while the data was read or written,
+     * for example a write and its invalidation came in between a read of
+     * the old data and this put. The data may be stale, do not cache it.
+     */
+
+    if (gen != g_cache.generation) {
+        goto out;
+    }
+
+    g_cache.generation++;
+
+    /* An item that does not fit on its own is just not cached */
+
+    if (entry_cost(len) > CONFIG_CA_COMSST_CACHE_SIZE) {
+        goto out;
+    }
+
+    while (g_cache.used + entry_cost(len) > CONFIG_CA_COMSST_CACHE_SIZE) {
+        entry_free(g_cache.tail);
+        g_cache.stats.evictions++;
+    }
+
+    e = malloc(entry_cost(len));
+    if (e == NULL) {
+        goto out;
+    }
+
+    memcpy(e->key, fullname, fullname_len);
+    e->key_len = fullname_len;
+    e->is_deletable = is_deletable;
+    e->len = len;
+    memcpy(e->data, data, len);
+    entry_push_front(e);
+    g_cache.used += entry_cost(len);
+    g_cache.stats.entries++;
+    g_cache.stats.bytes += len;
+
+out:
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+void comsst_cache_invalidate(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable)
+{
+    struct comsst_cache_entry* e;
+
+    if (CONFIG_CA_COMSST_CACHE_SIZE == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_cache.lock);
+    g_cache.generation++;
+    e = entry_find(fullname, fullname_len, is_deletable);
+    if (e != NULL) {
+        entry_free(e);
+    }
+
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+void comsst_cache_invalidate_prefix(const uint8_t* prefix,
+    uint32_t prefix_len, bool is_deletable)
+{
+    struct comsst_cache_entry* e;
+    struct comsst_cache_entry* next;
+
+    if (CONFIG_CA_COMSST_CACHE_SIZE == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_cache.lock);
+    g_cache.generation++;
+    for (e = g_cache.head; e != NULL; e = next) {
+        next = e->next;
+        if (e->is_deletable == is_deletable && e->key_len >= prefix_len
+            && memcmp(e->key, prefix, prefix_len) == 0) {
+            entry_free(e);
+        }
+    }
+
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+void comsst_cache_flush(void)
+{
+    pthread_mutex_lock(&g_cache.lock);
+    g_cache.generation++;
+    while (g_cache.head != NULL) {
+        entry_free(g_cache.head);
+    }
+
+    pthread_mutex_unlock(&g_cache.lock);
+}
+
+void comsst_cache_get_stats(struct comsst_cache_stats* stats)
+{
+    pthread_mutex_lock(&g_cache.lock);
+    *stats = g_cache.stats;
+    pthread_mutex_unlock(&g_cache.lock);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMSST_CACHE_H
+#define COMSST_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tee_client_api.h>
+
+#include <comsst_ca_api.h>
+
+/*
+ * Process wide read-through cache of comsst data, internal to the comsst
+ * CA library. Items are identified by "scope + name" and is_deletable.
+ * It holds at most CONFIG_CA_COMSST_CACHE_SIZE bytes, the least recently
+ * used items are evicted first. A size of 0 disables it.
+ */
+
+/*
+ * Copy the cached data of an item to buff. Returns false if the item is
+ * not cached, otherwise *res is TEEC_SUCCESS or TEEC_ERROR_SHORT_BUFFER
+ * and *len the length of the item.
+ */
+
+bool comsst_cache_get(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable, uint8_t* buff, uint32_t* len, TEEC_Result* res);
+
+/*
+ * The generation of the cache, changed by every put and invalidation.
+ * Sample it before reading or writing an item in the TEE, and pass it to
+ * comsst_cache_put().
+ */
+
+uint32_t comsst_cache_generation(void);
+
+/*
+ * Add or update an item. If the cache changed since generation gen was
+ * sampled, the data may already be stale and the item is dropped instead.
+ */
+
+void comsst_cache_put(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable, const uint8_t* data, uint32_t len, uint32_t gen);
+
+/* Drop an item */
+
+void comsst_cache_invalidate(const uint8_t* fullname, uint32_t fullname_len,
+    bool is_deletable);
+
+/* Drop every item whose "scope + name" starts with prefix */
+
+void comsst_cache_invalidate_prefix(const uint8_t* prefix,
+    uint32_t prefix_len, bool is_deletable);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMSST_CLIENT_H
+#define COMSST_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <tee_client_api.h>
+
+#include <comsst_ca_api.h>
+
+/*
+ * Commands of a comsst client that go to the TA without looking at the
+ * cache of the process, internal to the comsst CA library
+ */
+
+/*
+ * Read an item into buff, which holds *out_len bytes. *out_len is set to
+ * the length of the item, also when TEEC_ERROR_SHORT_BUFFER is returned.
+ */
+
+TEEC_Result comsst_client_read_tee(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len);
+
+/*
+ * Check that an item exists, TEEC_ERROR_ITEM_NOT_FOUND is returned if it
+ * does not
+ */
+
+TEEC_Result comsst_client_check_tee(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+#endif
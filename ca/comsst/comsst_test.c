@@ -16,9 +16,13 @@
 
 #include <nuttx/clock.h>
 #include <nuttx/config.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <comsst_ca_api.h>
 
@@ -38,22 +42,1038 @@ static void usage(void)
     printf("usage:\n"
            "\tca_comsst_test check scope name is_deletable\n"
            "\tca_comsst_test read scope name is_deletable\n"
+           "\tca_comsst_test stat scope name is_deletable\n"
+           "\tca_comsst_test cached scope name is_deletable\n"
            "\tca_comsst_test write scope name is_deletable data\n"
            "\tca_comsst_test delete scope name is_deletable\n"
            "\tca_comsst_test verify scope name is_deletable data\n"
+           "\tca_comsst_test digest scope name is_deletable\n"
+           "\tca_comsst_test cas scope name is_deletable old:new\n"
+           "\tca_comsst_test txn scope name:name is_deletable data\n"
+           "\tca_comsst_test async scope name is_deletable data\n"
+           "\tca_comsst_test read_direct scope name is_deletable\n"
+           "\tca_comsst_test write_direct scope name is_deletable data\n"
+           "\tca_comsst_test batch scope name is_deletable data\n"
+           "\tca_comsst_test stream scope name is_deletable size\n"
+           "\tca_comsst_test patch scope name is_deletable offset:data\n"
+           "\tca_comsst_test list scope is_deletable\n"
+           "\tca_comsst_test clear scope is_deletable\n"
+           "\tca_comsst_test fill scope count size\n"
+           "\tca_comsst_test zbench scope count\n"
+           "\tca_comsst_test bench scope [mix=read:write:delete:check]\n"
+           "\t\t[keys=n] [size=min:max] [threads=n] [warmup=s]\n"
+           "\t\t[duration=s] [format=text|json]\n"
            "\tExample: ca_comsst_test write scope name 0 test_data \n");
 }
 
+/* The stream test writes and reads back a counting pattern of this state */
+
+struct stream_state {
+    uint32_t size;
+    uint32_t pos;
+    bool mismatch;
+};
+
+static int32_t stream_source(uint8_t* buff, uint32_t len, void* priv)
+{
+    struct stream_state* st = priv;
+    uint32_t i;
+
+    if (len > st->size - st->pos) {
+        len = st->size - st->pos;
+    }
+
+    for (i = 0; i < len; i++) {
+        buff[i] = (uint8_t)(st->pos + i);
+    }
+
+    st->pos += len;
+    return len;
+}
+
+static int stream_sink(const uint8_t* buff, uint32_t len, void* priv)
+{
+    struct stream_state* st = priv;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (buff[i] != (uint8_t)(st->pos + i)) {
+            st->mismatch = true;
+        }
+    }
+
+    st->pos += len;
+    return 0;
+}
+
+static void print_name(const uint8_t* name, uint32_t len, void* priv)
+{
+    (*(uint32_t*)priv)++;
+    printf("%.*s\n", (int)len, name);
+}
+
+static int list_scope(uint8_t* scope, bool is_deletable)
+{
+    uint32_t count = 0;
+
+    if (comsst_list(scope, is_deletable, print_name, &count) != 0) {
+        printf("list failed.\n");
+        return -1;
+    }
+
+    printf("%ld items found.\n", count);
+    return 0;
+}
+
+/*
+ * Write count deletable items of size bytes in scope, then read them all
+ * back, and print the average latency of each and the bytes they take in
+ * the storage. Run it on a fresh scope with each storage layout of the TA,
+ * and its cache disabled, to compare them.
+ */
+
+static int fill_scope(uint8_t* scope, uint32_t count, uint32_t size)
+{
+    comsst_client_t* client;
+    uint8_t name[16];
+    uint32_t len;
+    uint32_t stored;
+    uint32_t objects;
+    uint32_t total = 0;
+    uint32_t total_objects = 0;
+    uint32_t i;
+    clock_t write_ticks;
+    clock_t read_ticks;
+    clock_t start;
+    int ret = -1;
+
+    if (count == 0 || size > sizeof(buffer)
+        || comsst_client_open(&client) != 0) {
+        printf("fill failed.\n");
+        return -1;
+    }
+
+    /* A tick is too coarse for one item, time the whole loops */
+
+    memset(buffer, 0x5a, size);
+    start = clock();
+    for (i = 0; i < count; i++) {
+        snprintf((char*)name, sizeof(name), "i%lu", i);
+        if (comsst_client_data_write(client, scope, name, true, buffer, size)
+            != 0) {
+            printf("item %s write failed.\n", name);
+            goto out;
+        }
+    }
+
+    write_ticks = clock() - start;
+    start = clock();
+    for (i = 0; i < count; i++) {
+        snprintf((char*)name, sizeof(name), "i%lu", i);
+        len = sizeof(buffer);
+        if (comsst_client_data_read(client, scope, name, true, buffer, &len)
+                != 0
+            || len != size) {
+            printf("item %s read failed.\n", name);
+            goto out;
+        }
+    }
+
+    read_ticks = clock() - start;
+    for (i = 0; i < count; i++) {
+        snprintf((char*)name, sizeof(name), "i%lu", i);
+        if (comsst_client_data_footprint(client, scope, name, true, &stored,
+                &objects)
+            != 0) {
+            printf("item %s stat failed.\n", name);
+            goto out;
+        }
+
+        total += stored;
+        total_objects += objects;
+    }
+
+    printf("%lu items of %lu bytes, %lu bytes of data\n", count, size,
+        count * size);
+    printf("write: %lu us/item, read: %lu us/item\n",
+        (uint32_t)TICK2USEC(write_ticks) / count,
+        (uint32_t)TICK2USEC(read_ticks) / count);
+    printf("stored: %lu bytes, %lu bytes/item, in %lu objects%s\n", total,
+        total / count, total_objects,
+        total_objects < count ? " and shared containers" : "");
+    ret = 0;
+
+out:
+    comsst_client_close(client);
+    return ret;
+}
+
+/*
+ * Write data as both items in one transaction, staging a delete of the
+ * second one first, then check that both hold it
+ */
+
+static int txn_items(uint8_t* scope, uint8_t* name1, uint8_t* name2,
+    bool is_deletable, uint8_t* data)
+{
+    comsst_client_t* client;
+    uint32_t len = strlen((char*)data);
+    uint32_t out_len;
+    int ret = -1;
+
+    if (comsst_client_open(&client) != 0) {
+        printf("txn failed.\n");
+        return -1;
+    }
+
+    if (comsst_client_txn_begin(client) != 0
+        || comsst_client_txn_delete(client, scope, name2, is_deletable) != 0
+        || comsst_client_txn_write(client, scope, name1, is_deletable, data,
+               len)
+            != 0
+        || comsst_client_txn_write(client, scope, name2, is_deletable, data,
+               len)
+            != 0) {
+        printf("txn stage failed.\n");
+        comsst_client_txn_abort(client);
+        goto out;
+    }
+
+    if (comsst_client_txn_commit(client) != 0) {
+        printf("txn commit failed.\n");
+        goto out;
+    }
+
+    out_len = sizeof(buffer);
+    if (comsst_client_data_read(client, scope, name1, is_deletable, buffer,
+            &out_len)
+            != 0
+        || out_len != len || memcmp(buffer, data, len) != 0) {
+        printf("item %s read back failed.\n", name1);
+        goto out;
+    }
+
+    out_len = sizeof(buffer);
+    if (comsst_client_data_read(client, scope, name2, is_deletable, buffer,
+            &out_len)
+            != 0
+        || out_len != len || memcmp(buffer, data, len) != 0) {
+        printf("item %s read back failed.\n", name2);
+        goto out;
+    }
+
+    printf("item txn successfully.\n");
+    ret = 0;
+
+out:
+    comsst_client_close(client);
+    return ret;
+}
+
+/*
+ * The async test runs write, read, check, delete and check of an item on a
+ * queue, first flushing after each operation so that each one runs alone,
+ * then queueing them all so that they run in a batch. Both rounds must get
+ * the same results.
+ */
+
+#define ASYNC_OPS 5
+
+struct async_result {
+    uint32_t res;
+    uint32_t len;
+};
+
+static void async_done(uint32_t res, uint8_t* buff, uint32_t len, void* arg)
+{
+    struct async_result* result = arg;
+
+    result->res = res;
+    result->len = len;
+}
+
+static int async_round(comsst_async_t* async, uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* data, bool batched)
+{
+    static const char* const names[ASYNC_OPS] = {
+        "write", "read", "check", "delete", "check",
+    };
+
+    static const uint32_t expected[ASYNC_OPS] = {
+        TEEC_SUCCESS, TEEC_SUCCESS, TEEC_SUCCESS, TEEC_SUCCESS,
+        TEEC_ERROR_ITEM_NOT_FOUND,
+    };
+
+    struct async_result results[ASYNC_OPS];
+    uint32_t len = strlen((char*)data);
+    uint32_t res;
+    int ret = 0;
+    int i;
+
+    memset(buffer, 0, sizeof(buffer));
+    for (i = 0; i < ASYNC_OPS; i++) {
+        results[i].res = TEEC_ERROR_GENERIC;
+        results[i].len = 0;
+        switch (i) {
+        case 0:
+            res = comsst_async_write(async, scope, name, is_deletable, data,
+                len, async_done, &results[i]);
+            break;
+        case 1:
+            res = comsst_async_read(async, scope, name, is_deletable, buffer,
+                sizeof(buffer), async_done, &results[i]);
+            break;
+        case 3:
+            res = comsst_async_delete(async, scope, name, is_deletable,
+                async_done, &results[i]);
+            break;
+        default:
+            res = comsst_async_check(async, scope, name, is_deletable,
+                async_done, &results[i]);
+            break;
+        }
+
+        if (res != TEEC_SUCCESS) {
+            printf("async %s queue failed, res = 0x%lx\n", names[i], res);
+            results[i].res = res;
+        }
+
+        if (!batched) {
+            comsst_async_flush(async);
+        }
+    }
+
+    comsst_async_flush(async);
+    for (i = 0; i < ASYNC_OPS; i++) {
+        printf("%s async %s: 0x%lx\n", batched ? "batched" : "lone", names[i],
+            results[i].res);
+        if (results[i].res != expected[i]) {
+            ret = -1;
+        }
+    }
+
+    if (results[1].len != len || memcmp(buffer, data, len) != 0) {
+        printf("%s async read back failed.\n", batched ? "batched" : "lone");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int async_items(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t* data)
+{
+    comsst_async_t* async;
+    int ret;
+
+    if (strlen((char*)data) > sizeof(buffer)) {
+        printf("async data too long.\n");
+        return -1;
+    }
+
+    if (comsst_async_open(&async, false) != 0) {
+        printf("async open failed.\n");
+        return -1;
+    }
+
+    ret = async_round(async, scope, name, is_deletable, data, false);
+    if (async_round(async, scope, name, is_deletable, data, true) != 0) {
+        ret = -1;
+    }
+
+    comsst_async_close(async);
+    printf(ret == 0 ? "item async successfully.\n" : "item async failed.\n");
+    return ret;
+}
+
+/* The payloads of the compression benchmark, ZBENCH_SIZE bytes each */
+
+#define ZBENCH_SIZE 2048
+
+static uint8_t zbench_payload[ZBENCH_SIZE];
+static uint8_t zbench_readback[ZBENCH_SIZE];
+
+/* A JSON configuration, keys repeat and values are short */
+
+static void zbench_json(uint8_t* buff, uint32_t size)
+{
+    uint32_t pos = 0;
+    uint32_t i = 0;
+    int n;
+
+    while (pos < size) {
+        n = snprintf((char*)buff + pos, size - pos,
+            "{\"id\":%lu,\"name\":\"sensor_%lu\",\"enabled\":%s,"
+            "\"interval_ms\":%lu,\"threshold\":%lu.%02lu},",
+            i, i % 16, i % 3 ? "true" : "false", 100 * (i % 10),
+            i * 7 % 100, i % 100);
+        if (n < 0 || (uint32_t)n >= size - pos) {
+            memset(buff + pos, ' ', size - pos);
+            break;
+        }
+
+        pos += n;
+        i++;
+    }
+}
+
+/* A protobuf message, tags and varints of repeated small fields */
+
+static void zbench_proto(uint8_t* buff, uint32_t size)
+{
+    uint32_t pos = 0;
+    uint32_t i = 0;
+    uint32_t v;
+
+    while (pos + 16 <= size) {
+        buff[pos++] = 0x08; /* field 1, varint */
+        for (v = 1000 + i * 13; v >= 0x80; v >>= 7) {
+            buff[pos++] = (v & 0x7f) | 0x80;
+        }
+
+        buff[pos++] = v;
+        buff[pos++] = 0x12; /* field 2, 6 bytes */
+        buff[pos++] = 6;
+        memcpy(buff + pos, "wlan0\0", 6);
+        buff[pos + 4] = '0' + i % 4;
+        pos += 6;
+        buff[pos++] = 0x18; /* field 3, varint */
+        buff[pos++] = i % 2;
+        i++;
+    }
+
+    memset(buff + pos, 0, size - pos);
+}
+
+/* Bytes no codec can shrink */
+
+static void zbench_random(uint8_t* buff, uint32_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        buff[i] = rand();
+    }
+}
+
+/*
+ * Write count items of each representative payload, read them back, and
+ * print the compression ratio and the average latency of each. Run it with
+ * the compression of the TA enabled and disabled to compare them.
+ */
+
+static int zbench_scope(uint8_t* scope, uint32_t count)
+{
+    static const struct {
+        const char* name;
+        void (*fill)(uint8_t* buff, uint32_t size);
+    } payloads[] = {
+        { "json", zbench_json },
+        { "proto", zbench_proto },
+        { "random", zbench_random },
+    };
+
+    comsst_client_t* client;
+    uint8_t name[16];
+    uint32_t stored;
+    uint32_t len;
+    uint32_t i;
+    uint32_t p;
+    clock_t write_ticks;
+    clock_t read_ticks;
+    clock_t start;
+    int ret = -1;
+
+    if (count == 0 || comsst_client_open(&client) != 0) {
+        printf("zbench failed.\n");
+        return -1;
+    }
+
+    printf("payload bytes stored ratio write_us read_us\n");
+    for (p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++) {
+        payloads[p].fill(zbench_payload, ZBENCH_SIZE);
+
+        /* A tick is too coarse for one item, time the whole loops */
+
+        start = clock();
+        for (i = 0; i < count; i++) {
+            snprintf((char*)name, sizeof(name), "z%lu", i);
+            if (comsst_client_data_write_ex(client, scope, name, true,
+                    zbench_payload, ZBENCH_SIZE, COMSST_FLAG_COMPRESS)
+                != 0) {
+                printf("item %s write failed.\n", name);
+                goto out;
+            }
+        }
+
+        write_ticks = clock() - start;
+        start = clock();
+        for (i = 0; i < count; i++) {
+            snprintf((char*)name, sizeof(name), "z%lu", i);
+            len = ZBENCH_SIZE;
+            if (comsst_client_data_read(client, scope, name, true,
+                    zbench_readback, &len)
+                    != 0
+                || len != ZBENCH_SIZE
+                || memcmp(zbench_readback, zbench_payload, len) != 0) {
+                printf("item %s read failed.\n", name);
+                goto out;
+            }
+        }
+
+        read_ticks = clock() - start;
+        if (comsst_client_data_stored_size(client, scope, (uint8_t*)"z0",
+                true, &stored)
+            != 0) {
+            printf("item z0 stat failed.\n");
+            goto out;
+        }
+
+        printf("%s %d %lu %lu.%02lu %lu %lu\n", payloads[p].name,
+            ZBENCH_SIZE, stored, ZBENCH_SIZE / stored,
+            ZBENCH_SIZE * 100 / stored % 100,
+            (uint32_t)TICK2USEC(write_ticks) / count,
+            (uint32_t)TICK2USEC(read_ticks) / count);
+    }
+
+    ret = 0;
+
+out:
+    for (i = 0; i < count; i++) {
+        snprintf((char*)name, sizeof(name), "z%lu", i);
+        comsst_client_data_delete(client, scope, name, true);
+    }
+
+    comsst_client_close(client);
+    return ret;
+}
+
+/*
+ * The load generator: threads each with their own session run a random mix
+ * of operations on keys items of scope, for warmup seconds unmeasured and
+ * then for duration seconds measured, and the latencies of each operation
+ * are kept in a histogram of microseconds.
+ */
+
+enum {
+    BENCH_READ,
+    BENCH_WRITE,
+    BENCH_DELETE,
+    BENCH_CHECK,
+    BENCH_OPS
+};
+
+enum {
+    BENCH_WARMUP,
+    BENCH_MEASURE,
+    BENCH_STOP
+};
+
+#define BENCH_THREADS_MAX 16
+#define BENCH_SIZE_MAX 4096
+
+/* Buckets are exact below BENCH_LINEAR us, and 1/BENCH_SUB wide above it */
+
+#define BENCH_SUB_BITS 5
+#define BENCH_SUB (1 << BENCH_SUB_BITS)
+#define BENCH_LINEAR (BENCH_SUB * 2)
+#define BENCH_BUCKETS (BENCH_LINEAR + (31 - BENCH_SUB_BITS) * BENCH_SUB)
+
+static const char* const bench_names[BENCH_OPS] = {
+    "read",
+    "write",
+    "delete",
+    "check",
+};
+
+struct bench_hist {
+    uint32_t count;
+    uint32_t errors;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[BENCH_BUCKETS];
+};
+
+struct bench_config {
+    uint8_t* scope;
+    uint32_t mix[BENCH_OPS]; /* the weight of each operation */
+    uint32_t mix_total;
+    uint32_t keys;
+    uint32_t size_min;
+    uint32_t size_max;
+    uint32_t threads;
+    uint32_t warmup; /* seconds */
+    uint32_t duration; /* seconds */
+    bool json;
+};
+
+struct bench_thread {
+    pthread_t thread;
+    const struct bench_config* config;
+    unsigned int seed;
+    uint8_t buff[BENCH_SIZE_MAX];
+    struct bench_hist hist[BENCH_OPS];
+    int ret;
+};
+
+static atomic_int bench_phase;
+
+static uint64_t bench_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t bench_bucket(uint32_t us)
+{
+    uint32_t e;
+
+    if (us < BENCH_LINEAR) {
+        return us;
+    }
+
+    e = 31 - __builtin_clz(us);
+    return BENCH_LINEAR + (e - BENCH_SUB_BITS - 1) * BENCH_SUB
+        + ((us >> (e - BENCH_SUB_BITS)) & (BENCH_SUB - 1));
+}
+
+/* The largest latency that falls in bucket b */
+
+static uint32_t bench_bucket_max(uint32_t b)
+{
+    uint32_t e;
+    uint32_t s;
+
+    if (b < BENCH_LINEAR) {
+        return b;
+    }
+
+    b -= BENCH_LINEAR;
+    e = b / BENCH_SUB + BENCH_SUB_BITS + 1;
+    s = b % BENCH_SUB;
+    return ((BENCH_SUB + s + 1) << (e - BENCH_SUB_BITS)) - 1;
+}
+
+static void bench_record(struct bench_hist* hist, uint32_t us, bool error)
+{
+    hist->count++;
+    hist->errors += error;
+    hist->sum += us;
+    if (us > hist->max) {
+        hist->max = us;
+    }
+
+    hist->buckets[bench_bucket(us)]++;
+}
+
+static void bench_merge(struct bench_hist* to, const struct bench_hist* from)
+{
+    uint32_t b;
+
+    to->count += from->count;
+    to->errors += from->errors;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+
+    for (b = 0; b < BENCH_BUCKETS; b++) {
+        to->buckets[b] += from->buckets[b];
+    }
+}
+
+/* The latency that pct percent of the operations do not exceed */
+
+static uint32_t bench_percentile(const struct bench_hist* hist, uint32_t pct)
+{
+    uint64_t rank = ((uint64_t)hist->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    uint32_t b;
+
+    for (b = 0; b < BENCH_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank && seen > 0) {
+            return bench_bucket_max(b) < hist->max ? bench_bucket_max(b)
+                                                   : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+static uint32_t bench_size(const struct bench_config* config,
+    unsigned int* seed)
+{
+    return config->size_min
+        + rand_r(seed) % (config->size_max - config->size_min + 1);
+}
+
+static void* bench_worker(void* arg)
+{
+    struct bench_thread* t = arg;
+    const struct bench_config* config = t->config;
+    comsst_client_t* client;
+    uint8_t name[16];
+    uint32_t pick;
+    uint32_t len;
+    uint32_t res;
+    uint32_t op;
+    uint64_t start;
+    uint32_t us;
+    int phase;
+
+    if (comsst_client_open(&client) != 0) {
+        t->ret = -1;
+        return NULL;
+    }
+
+    while ((phase = atomic_load(&bench_phase)) != BENCH_STOP) {
+        snprintf((char*)name, sizeof(name), "b%lu",
+            rand_r(&t->seed) % config->keys);
+        pick = rand_r(&t->seed) % config->mix_total;
+        for (op = 0; pick >= config->mix[op]; op++) {
+            pick -= config->mix[op];
+        }
+
+        start = bench_now_us();
+        switch (op) {
+        case BENCH_READ:
+            len = sizeof(t->buff);
+            res = comsst_client_data_read(client, config->scope, name, true,
+                t->buff, &len);
+            break;
+        case BENCH_WRITE:
+            res = comsst_client_data_write(client, config->scope, name, true,
+                t->buff, bench_size(config, &t->seed));
+            break;
+        case BENCH_DELETE:
+            res = comsst_client_data_delete(client, config->scope, name,
+                true);
+            break;
+        default:
+            res = comsst_client_data_check(client, config->scope, name,
+                true);
+            break;
+        }
+
+        us = bench_now_us() - start;
+
+        /* Only time the operations run wholly inside the measured window */
+
+        if (phase == BENCH_MEASURE
+            && atomic_load(&bench_phase) == BENCH_MEASURE) {
+            bench_record(&t->hist[op], us,
+                res != 0 && res != TEEC_ERROR_ITEM_NOT_FOUND);
+        }
+    }
+
+    comsst_client_close(client);
+    return NULL;
+}
+
+/* Parse up to max values separated by ':', return how many there were */
+
+static uint32_t bench_parse_list(const char* str, uint32_t* vals, uint32_t max)
+{
+    uint32_t n = 0;
+    char* end;
+
+    while (n < max) {
+        vals[n++] = strtoul(str, &end, 10);
+        if (end == str || (*end != ':' && *end != '\0')) {
+            return 0;
+        }
+
+        if (*end == '\0') {
+            return n;
+        }
+
+        str = end + 1;
+    }
+
+    return 0;
+}
+
+static int bench_parse(struct bench_config* config, int argc, char* argv[])
+{
+    uint32_t vals[BENCH_OPS];
+    uint32_t n;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char* val = strchr(argv[i], '=');
+
+        if (val == NULL) {
+            return -1;
+        }
+
+        *val++ = '\0';
+        if (strcmp(argv[i], "mix") == 0) {
+            n = bench_parse_list(val, vals, BENCH_OPS);
+            if (n == 0) {
+                return -1;
+            }
+
+            memset(config->mix, 0, sizeof(config->mix));
+            memcpy(config->mix, vals, n * sizeof(vals[0]));
+        } else if (strcmp(argv[i], "size") == 0) {
+            n = bench_parse_list(val, vals, 2);
+            if (n == 0) {
+                return -1;
+            }
+
+            config->size_min = vals[0];
+            config->size_max = vals[n - 1];
+        } else if (strcmp(argv[i], "keys") == 0) {
+            config->keys = strtoul(val, NULL, 10);
+        } else if (strcmp(argv[i], "threads") == 0) {
+            config->threads = strtoul(val, NULL, 10);
+        } else if (strcmp(argv[i], "warmup") == 0) {
+            config->warmup = strtoul(val, NULL, 10);
+        } else if (strcmp(argv[i], "duration") == 0) {
+            config->duration = strtoul(val, NULL, 10);
+        } else if (strcmp(argv[i], "format") == 0) {
+            if (strcmp(val, "json") == 0) {
+                config->json = true;
+            } else if (strcmp(val, "text") == 0) {
+                config->json = false;
+            } else {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+
+    config->mix_total = 0;
+    for (i = 0; i < BENCH_OPS; i++) {
+        config->mix_total += config->mix[i];
+    }
+
+    if (config->mix_total == 0 || config->keys == 0
+        || config->size_min == 0 || config->size_min > config->size_max
+        || config->size_max > BENCH_SIZE_MAX || config->threads == 0
+        || config->threads > BENCH_THREADS_MAX || config->duration == 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bench_report(const struct bench_config* config,
+    const struct bench_hist* hist, const char* name, uint64_t elapsed,
+    bool first)
+{
+    uint64_t rate = (uint64_t)hist->count * 1000000 / elapsed;
+    uint64_t mean = hist->count ? hist->sum / hist->count : 0;
+
+    if (config->json) {
+        printf("%s\"%s\":{\"count\":%lu,\"errors\":%lu,\"ops_per_s\":%llu,"
+               "\"mean_us\":%llu,\"p50_us\":%lu,\"p90_us\":%lu,"
+               "\"p99_us\":%lu,\"max_us\":%lu}",
+            first ? "" : ",", name, hist->count, hist->errors,
+            (unsigned long long)rate, (unsigned long long)mean,
+            bench_percentile(hist, 50), bench_percentile(hist, 90),
+            bench_percentile(hist, 99), hist->max);
+    } else {
+        printf("%-6s %8lu %6lu %8llu %7llu %7lu %7lu %7lu %7lu\n", name,
+            hist->count, hist->errors, (unsigned long long)rate,
+            (unsigned long long)mean, bench_percentile(hist, 50),
+            bench_percentile(hist, 90), bench_percentile(hist, 99),
+            hist->max);
+    }
+}
+
+static int bench_scope(uint8_t* scope, int argc, char* argv[])
+{
+    struct bench_config config = {
+        .scope = scope,
+        .mix = { 80, 20, 0, 0 },
+        .keys = 64,
+        .size_min = 64,
+        .size_max = 64,
+        .threads = 1,
+        .warmup = 1,
+        .duration = 10,
+    };
+
+    struct bench_thread* threads;
+    struct bench_hist* total;
+    comsst_client_t* client;
+    pthread_attr_t attr;
+    uint8_t name[16];
+    unsigned int seed = 1;
+    uint64_t elapsed;
+    uint32_t started = 0;
+    uint32_t i;
+    uint32_t op;
+    bool first = true;
+    int ret = -1;
+
+    if (bench_parse(&config, argc, argv) != 0) {
+        printf("Invalid bench argument\n");
+        usage();
+        return -1;
+    }
+
+    threads = calloc(config.threads, sizeof(*threads));
+    total = calloc(BENCH_OPS + 1, sizeof(*total));
+    if (threads == NULL || total == NULL
+        || comsst_client_open(&client) != 0) {
+        printf("bench failed.\n");
+        free(threads);
+        free(total);
+        return -1;
+    }
+
+    /* Write every key first, so that reads hit until deletes remove them */
+
+    memset(threads[0].buff, 0x5a, sizeof(threads[0].buff));
+    for (i = 0; i < config.keys; i++) {
+        snprintf((char*)name, sizeof(name), "b%lu", i);
+        if (comsst_client_data_write(client, scope, name, true,
+                threads[0].buff, bench_size(&config, &seed))
+            != 0) {
+            printf("item %s write failed.\n", name);
+            goto out;
+        }
+    }
+
+    atomic_store(&bench_phase, BENCH_WARMUP);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, CONFIG_CA_COMSST_TEST_STACKSIZE);
+    for (i = 0; i < config.threads; i++) {
+        threads[i].config = &config;
+        threads[i].seed = i + 1;
+        memset(threads[i].buff, 0x5a, sizeof(threads[i].buff));
+        if (pthread_create(&threads[i].thread, &attr, bench_worker,
+                &threads[i])
+            != 0) {
+            printf("thread %lu create failed.\n", i);
+            break;
+        }
+
+        started++;
+    }
+
+    pthread_attr_destroy(&attr);
+    if (started == config.threads) {
+        sleep(config.warmup);
+        elapsed = bench_now_us();
+        atomic_store(&bench_phase, BENCH_MEASURE);
+        sleep(config.duration);
+        atomic_store(&bench_phase, BENCH_STOP);
+        elapsed = bench_now_us() - elapsed;
+    }
+
+    atomic_store(&bench_phase, BENCH_STOP);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    if (started != config.threads) {
+        goto out;
+    }
+
+    for (i = 0; i < config.threads; i++) {
+        if (threads[i].ret != 0) {
+            printf("thread %lu session open failed.\n", i);
+            goto out;
+        }
+
+        for (op = 0; op < BENCH_OPS; op++) {
+            bench_merge(&total[op], &threads[i].hist[op]);
+            bench_merge(&total[BENCH_OPS], &threads[i].hist[op]);
+        }
+    }
+
+    if (config.json) {
+        printf("{\"mix\":\"%lu:%lu:%lu:%lu\",\"threads\":%lu,\"keys\":%lu,"
+               "\"size_min\":%lu,\"size_max\":%lu,\"warmup_s\":%lu,"
+               "\"duration_s\":%lu,\"elapsed_us\":%llu,\"ops\":{",
+            config.mix[BENCH_READ], config.mix[BENCH_WRITE],
+            config.mix[BENCH_DELETE], config.mix[BENCH_CHECK], config.threads,
+            config.keys, config.size_min, config.size_max, config.warmup,
+            config.duration, (unsigned long long)elapsed);
+    } else {
+        printf("%lu threads, %lu keys of %lu-%lu bytes, %llu us measured\n",
+            config.threads, config.keys, config.size_min, config.size_max,
+            (unsigned long long)elapsed);
+        printf("op        count errors    ops/s mean_us  p50_us  p90_us "
+               " p99_us  max_us\n");
+    }
+
+    for (op = 0; op < BENCH_OPS; op++) {
+        if (config.mix[op] != 0) {
+            bench_report(&config, &total[op], bench_names[op], elapsed,
+                first);
+            first = false;
+        }
+    }
+
+    if (config.json) {
+        printf("},");
+        bench_report(&config, &total[BENCH_OPS], "total", elapsed, true);
+        printf("}\n");
+    } else {
+        bench_report(&config, &total[BENCH_OPS], "total", elapsed, true);
+    }
+
+    ret = 0;
+
+out:
+    for (i = 0; i < config.keys; i++) {
+        snprintf((char*)name, sizeof(name), "b%lu", i);
+        comsst_client_data_delete(client, scope, name, true);
+    }
+
+    comsst_client_close(client);
+    free(threads);
+    free(total);
+    return ret;
+}
+
 int main(int argc, FAR char* argv[])
 {
     /*
-     * argv[1] : check/read/write/delete/verify
+     * argv[1] : the operation, see usage()
      * argv[2] : scope
      * argv[3] : name
      * argv[4] : 0(undeletable) 1(deletable)
      * argv[5] : write data(when argv[1] is write)
      */
 
+    if (argc == 4 && strcmp(argv[1], "list") == 0) {
+        return list_scope((uint8_t*)argv[2], atoi(argv[3]) == 1);
+    }
+
+    if (argc == 5 && strcmp(argv[1], "fill") == 0) {
+        return fill_scope((uint8_t*)argv[2], atoi(argv[3]), atoi(argv[4]));
+    }
+
+    if (argc == 4 && strcmp(argv[1], "zbench") == 0) {
+        return zbench_scope((uint8_t*)argv[2], atoi(argv[3]));
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "bench") == 0) {
+        return bench_scope((uint8_t*)argv[2], argc - 3, argv + 3);
+    }
+
+    if (argc == 4 && strcmp(argv[1], "clear") == 0) {
+        uint32_t count = 0;
+
+        if (comsst_scope_clear((uint8_t*)argv[2], atoi(argv[3]) == 1, &count)
+            != 0) {
+            printf("clear failed, %ld items deleted.\n", count);
+            return -1;
+        }
+
+        printf("%ld items deleted.\n", count);
+        return 0;
+    }
+
     if (argc != 5 && argc != 6) {
         printf("Invalid argument number\n");
         usage();
@@ -81,14 +1101,43 @@ int main(int argc, FAR char* argv[])
             printf("item del fail.\n");
         }
     } else if (argc == 5 && strcmp(argv[1], "read") == 0) {
-        len = 512;
-        memset(buffer, 0, 512);
-        if (comsst_data_read(scope, name, is_deletable, buffer, &len) == 0) {
+        uint8_t* data;
+
+        if (comsst_data_read_alloc(scope, name, is_deletable, &data, &len)
+            == 0) {
             printf("item read successfully. len = %ld\n", len);
-            printf("item:%s\n", buffer);
+            printf("item:%.*s\n", (int)len, data);
+            free(data);
         } else {
             printf("item read failed.\n");
         }
+    } else if (argc == 5 && strcmp(argv[1], "stat") == 0) {
+        uint32_t flags;
+
+        if (comsst_data_stat(scope, name, is_deletable, &len, &flags) == 0) {
+            printf("item len = %ld, flags = 0x%08lx\n", len, flags);
+        } else {
+            printf("item stat failed.\n");
+        }
+    } else if (argc == 5 && strcmp(argv[1], "cached") == 0) {
+        struct comsst_cache_stats stats;
+        int i;
+
+        /* The second read is served from the cache if it is enabled */
+
+        for (i = 0; i < 2; i++) {
+            len = 512;
+            if (comsst_data_read_ex(scope, name, is_deletable, buffer, &len,
+                    COMSST_FLAG_CACHEABLE)
+                != 0) {
+                printf("item read failed.\n");
+                break;
+            }
+        }
+
+        comsst_cache_get_stats(&stats);
+        printf("cache hits = %ld, misses = %ld, entries = %ld, bytes = %ld\n",
+            stats.hits, stats.misses, stats.entries, stats.bytes);
     } else if (argc == 6 && strcmp(argv[1], "write") == 0) {
         if (comsst_data_write(scope, name, is_deletable, (uint8_t*)argv[5],
                 strlen(argv[5]))
@@ -97,6 +1146,92 @@ int main(int argc, FAR char* argv[])
         } else {
             printf("item write failed.\n");
         }
+    } else if (argc == 5 && strcmp(argv[1], "read_direct") == 0) {
+        len = 512;
+        memset(buffer, 0, 512);
+        if (comsst_data_read_direct(scope, name, is_deletable, buffer, &len)
+            == 0) {
+            printf("item read successfully. len = %ld\n", len);
+            printf("item:%s\n", buffer);
+        } else {
+            printf("item read failed.\n");
+        }
+    } else if (argc == 6 && strcmp(argv[1], "write_direct") == 0) {
+        if (comsst_data_write_direct(scope, name, is_deletable,
+                (uint8_t*)argv[5], strlen(argv[5]))
+            == 0) {
+            printf("item write successfully.\n");
+        } else {
+            printf("item write failed.\n");
+        }
+    } else if (argc == 6 && strcmp(argv[1], "batch") == 0) {
+        comsst_batch_t* batch;
+        uint32_t i;
+
+        /* write, check, read back and verify with a single invoke */
+
+        len = strlen(argv[5]);
+        memset(buffer, 0, sizeof(buffer));
+        if (comsst_batch_create(&batch) != 0) {
+            printf("batch create failed.\n");
+            return -1;
+        }
+
+        comsst_batch_add_write(batch, scope, name, is_deletable,
+            (uint8_t*)argv[5], len);
+        comsst_batch_add_check(batch, scope, name, is_deletable);
+        comsst_batch_add_read(batch, scope, name, is_deletable, buffer,
+            sizeof(buffer) - 1);
+        comsst_batch_add_verify(batch, scope, name, is_deletable,
+            (uint8_t*)argv[5], len);
+
+        res = comsst_batch_run(batch, true);
+        if (res == 0) {
+            for (i = 0; i < 4; i++) {
+                printf("op %ld: 0x%08lx\n", i,
+                    comsst_batch_get_result(batch, i, NULL));
+            }
+
+            printf("item:%s\n", buffer);
+        } else {
+            printf("batch run failed.\n");
+        }
+
+        comsst_batch_destroy(batch);
+    } else if (argc == 6 && strcmp(argv[1], "stream") == 0) {
+        struct stream_state st = { .size = atoi(argv[5]) };
+
+        res = comsst_data_write_stream(scope, name, is_deletable,
+            stream_source, &st);
+        if (res != 0) {
+            printf("item stream write failed.\n");
+            return -1;
+        }
+
+        st.pos = 0;
+        res = comsst_data_read_stream(scope, name, is_deletable, stream_sink,
+            &st);
+        if (res == 0 && st.pos == st.size && !st.mismatch) {
+            printf("item stream of %ld bytes successfully.\n", st.size);
+        } else {
+            printf("item stream read failed, %ld bytes read.\n", st.pos);
+        }
+    } else if (argc == 6 && strcmp(argv[1], "patch") == 0) {
+        char* data = strchr(argv[5], ':');
+
+        if (data == NULL) {
+            printf("Invalid patch, use offset:data\n");
+            return -1;
+        }
+
+        data++;
+        if (comsst_data_patch(scope, name, is_deletable, atoi(argv[5]),
+                (uint8_t*)data, strlen(data), false)
+            == 0) {
+            printf("item patch successfully.\n");
+        } else {
+            printf("item patch failed.\n");
+        }
     } else if (argc == 6 && strcmp(argv[1], "verify") == 0) {
         res = comsst_data_verify(scope, name, is_deletable, (uint8_t*)argv[5],
             strlen(argv[5]));
@@ -107,6 +1242,62 @@ int main(int argc, FAR char* argv[])
         } else {
             printf("item verify failed.\n");
         }
+    } else if (argc == 6 && strcmp(argv[1], "cas") == 0) {
+        char* value = strchr(argv[5], ':');
+
+        /* An empty old value expects the item not to exist */
+
+        if (value == NULL) {
+            usage();
+            return -1;
+        }
+
+        *value++ = '\0';
+        res = comsst_data_cas(scope, name, is_deletable,
+            argv[5][0] != '\0' ? (uint8_t*)argv[5] : NULL, strlen(argv[5]),
+            (uint8_t*)value, strlen(value));
+        if (res == 0) {
+            printf("item cas successfully.\n");
+        } else if (res == TEEC_ERROR_ACCESS_CONFLICT) {
+            printf("item cas conflict.\n");
+        } else {
+            printf("item cas failed.\n");
+        }
+    } else if (argc == 6 && strcmp(argv[1], "txn") == 0) {
+        char* name2 = strchr((char*)name, ':');
+
+        if (name2 == NULL) {
+            usage();
+            return -1;
+        }
+
+        *name2++ = '\0';
+        txn_items(scope, name, (uint8_t*)name2, is_deletable,
+            (uint8_t*)argv[5]);
+    } else if (argc == 6 && strcmp(argv[1], "async") == 0) {
+        async_items(scope, name, is_deletable, (uint8_t*)argv[5]);
+    } else if (argc == 5 && strcmp(argv[1], "digest") == 0) {
+        uint8_t digest[COMSST_DIGEST_LEN];
+        int i;
+
+        /* Verifying with the digest just read must always succeed */
+
+        if (comsst_data_digest(scope, name, is_deletable, digest) != 0) {
+            printf("item digest failed.\n");
+        } else {
+            printf("item digest:");
+            for (i = 0; i < COMSST_DIGEST_LEN; i++) {
+                printf("%02x", digest[i]);
+            }
+
+            printf("\n");
+            if (comsst_data_verify_digest(scope, name, is_deletable, digest)
+                == 0) {
+                printf("item verify by digest successfully.\n");
+            } else {
+                printf("item verify by digest failed.\n");
+            }
+        }
     } else {
         printf("Unrecognized option: %s\n", argv[1]);
         usage();
@@ -15,326 +15,252 @@
  */
 
 #include <nuttx/config.h>
+#include <pin_ca_api.h>
 #include <pin_ta.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <tee_client_api.h>
+#include <tee_shm_pool.h>
 #include <teec_trace.h>
 
-uint32_t pin_store(bool is_deletable, uint8_t* buff, uint32_t len)
-{
-    TEEC_Result res = TEEC_ERROR_GENERIC;
+struct pin_handle {
     TEEC_Context ctx;
     TEEC_Session sess;
+    struct tee_shm_pool pool;
+};
+
+static TEEC_Result pin_invoke(pin_handle_t* handle, uint32_t cmd,
+    TEEC_Operation* op)
+{
+    TEEC_Result res;
+    uint32_t err_origin;
+
+    res = TEEC_InvokeCommand(&handle->sess, cmd, op, &err_origin);
+    if (res != TEEC_SUCCESS) {
+        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
+            res, err_origin);
+    }
+
+    return res;
+}
+
+uint32_t pin_open(pin_handle_t** handle)
+{
+    TEEC_Result res = TEEC_ERROR_GENERIC;
     TEEC_Operation op;
     TEEC_UUID uuid = TA_PIN_UUID;
-    TEEC_SharedMemory io_shm;
+    pin_handle_t* h;
     uint32_t err_origin;
 
+    if (handle == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
+
+    h = malloc(sizeof(*h));
+    if (h == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
+
     /* Initialize a context connecting us to the TEE */
 
     DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    res = TEEC_InitializeContext(NULL, &h->ctx);
 
     if (res != TEEC_SUCCESS) {
         EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        goto exit_free;
     }
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
-    }
-
-    memcpy(io_shm.buffer, buff, len);
-
     op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
         TEEC_NONE);
 
     DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
+    res = TEEC_OpenSession(&h->ctx, &h->sess, &uuid,
         TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
     if (res != TEEC_SUCCESS) {
         EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
             res, err_origin);
-        goto exit_free_mem;
+        goto exit_finalize;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    tee_shm_pool_init(&h->pool, &h->ctx);
+    *handle = h;
+    return TEEC_SUCCESS;
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_STORE, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
-    }
-
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
 exit_finalize:
     DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    TEEC_FinalizeContext(&h->ctx);
+exit_free:
+    free(h);
     return res;
 }
 
-uint32_t pin_verify(bool is_deletable, uint8_t* buff, uint32_t len)
+void pin_close(pin_handle_t* handle)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_PIN_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    if (handle == NULL) {
+        return;
+    }
 
-    /* Initialize a context connecting us to the TEE */
+    DMSG("TEEC_CloseSession...\n");
+    TEEC_CloseSession(&handle->sess);
+    tee_shm_pool_deinit(&handle->pool);
+    DMSG("TEEC_FinalizeContext...\n");
+    TEEC_FinalizeContext(&handle->ctx);
+    free(handle);
+}
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+void pin_get_shm_stats(pin_handle_t* handle, struct tee_shm_pool_stats* stats)
+{
+    tee_shm_pool_get_stats(&handle->pool, stats);
+}
 
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
-    }
+uint32_t pin_handle_store(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len)
+{
+    TEEC_Result res = TEEC_ERROR_GENERIC;
+    TEEC_Operation op;
+    struct tee_shm_slab io_shm;
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = tee_shm_pool_alloc(&handle->pool, len, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
     memcpy(io_shm.buffer, buff, len);
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
-    }
-
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE);
     op.params[0].value.a = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    tee_shm_pool_memref(&io_shm, len, &op.params[1]);
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_VERIFY, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
-    }
+    res = pin_invoke(handle, TA_PIN_CMD_STORE, &op);
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    tee_shm_pool_free(&handle->pool, &io_shm);
     return res;
 }
 
-uint32_t pin_change(bool is_deletable, uint8_t* old, uint32_t oldlen,
-    uint8_t* new, uint32_t newlen)
+uint32_t pin_handle_verify(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len)
 {
     TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_PIN_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    struct tee_shm_slab io_shm;
 
-    /* Initialize a context connecting us to the TEE */
+    /* Clear the TEEC_Operation struct */
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    memset(&op, 0, sizeof(op));
 
+    res = tee_shm_pool_alloc(&handle->pool, len, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
     }
 
+    memcpy(io_shm.buffer, buff, len);
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = is_deletable ? 1 : 0;
+    tee_shm_pool_memref(&io_shm, len, &op.params[1]);
+
+    res = pin_invoke(handle, TA_PIN_CMD_VERIFY, &op);
+
+    tee_shm_pool_free(&handle->pool, &io_shm);
+    return res;
+}
+
+uint32_t pin_handle_change(pin_handle_t* handle, bool is_deletable,
+    uint8_t* old, uint32_t oldlen, uint8_t* new, uint32_t newlen)
+{
+    TEEC_Result res = TEEC_ERROR_GENERIC;
+    TEEC_Operation op;
+    struct tee_shm_slab io_shm;
+
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = oldlen + newlen;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = tee_shm_pool_alloc(&handle->pool, oldlen + newlen, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
     memcpy(io_shm.buffer, old, oldlen);
-    memcpy(io_shm.buffer + oldlen, new, newlen);
-
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
-    }
+    memcpy((uint8_t*)io_shm.buffer + oldlen, new, newlen);
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE);
     op.params[0].value.a = is_deletable ? 1 : 0;
     op.params[0].value.b = oldlen;
-    op.params[1].memref.parent = &io_shm;
+    tee_shm_pool_memref(&io_shm, oldlen + newlen, &op.params[1]);
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_CHANGE, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
-    }
+    res = pin_invoke(handle, TA_PIN_CMD_CHANGE, &op);
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    tee_shm_pool_free(&handle->pool, &io_shm);
     return res;
 }
 
-uint32_t pin_getsha256(bool is_deletable, uint8_t* buff, uint32_t len)
+uint32_t pin_handle_getsha256(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len)
 {
     TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_PIN_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    struct tee_shm_slab io_shm;
 
     if (len != 32) {
         return (uint32_t)-1;
     }
 
-    /* Initialize a context connecting us to the TEE */
-
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
-
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
-    }
-
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = 32;
-    io_shm.flags = TEEC_MEM_OUTPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = tee_shm_pool_alloc(&handle->pool, 32, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08lx\n", res);
-        goto exit_finalize;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_free_mem;
-    }
-
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_WHOLE,
-        TEEC_NONE, TEEC_NONE);
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+        TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE, TEEC_NONE);
     op.params[0].value.a = is_deletable ? 1 : 0;
-    op.params[1].memref.parent = &io_shm;
+    tee_shm_pool_memref(&io_shm, 32, &op.params[1]);
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_GETSHA256, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+    res = pin_invoke(handle, TA_PIN_CMD_GETSHA256, &op);
+    if (res == TEEC_SUCCESS) {
+        memcpy(buff, io_shm.buffer, 32);
     }
 
-    memcpy(buff, io_shm.buffer, 32);
-
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    tee_shm_pool_free(&handle->pool, &io_shm);
     return res;
 }
 
-bool pin_is_exist(bool is_deletable)
+bool pin_handle_is_exist(pin_handle_t* handle, bool is_deletable)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_PIN_UUID;
-    uint32_t err_origin;
 
-    /* Initialize a context connecting us to the TEE */
+    /* Clear the TEEC_Operation struct */
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    memset(&op, 0, sizeof(op));
 
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
-    }
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE,
+        TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = is_deletable ? 1 : 0;
+
+    return pin_invoke(handle, TA_PIN_CMD_CHK, &op) == TEEC_SUCCESS;
+}
+
+uint32_t pin_handle_delete(pin_handle_t* handle, bool is_deletable)
+{
+    TEEC_Operation op;
 
     /* Clear the TEEC_Operation struct */
 
@@ -342,93 +268,101 @@ bool pin_is_exist(bool is_deletable)
 
     op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
         TEEC_NONE);
+    op.params[0].value.a = is_deletable ? 1 : 0;
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    return pin_invoke(handle, TA_PIN_CMD_DEL, &op);
+}
+
+uint32_t pin_store(bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    pin_handle_t* handle;
+    uint32_t res;
+
+    res = pin_open(&handle);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_finalize;
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].value.a = is_deletable ? 1 : 0;
+    res = pin_handle_store(handle, is_deletable, buff, len);
+    pin_close(handle);
+    return res;
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_CHK, &op, &err_origin);
+uint32_t pin_verify(bool is_deletable, uint8_t* buff, uint32_t len)
+{
+    pin_handle_t* handle;
+    uint32_t res;
+
+    res = pin_open(&handle);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = pin_handle_verify(handle, is_deletable, buff, len);
+    pin_close(handle);
+    return res;
+}
+
+uint32_t pin_change(bool is_deletable, uint8_t* old, uint32_t oldlen,
+    uint8_t* new, uint32_t newlen)
+{
+    pin_handle_t* handle;
+    uint32_t res;
+
+    res = pin_open(&handle);
     if (res != TEEC_SUCCESS) {
-        return false;
-    } else {
-        return true;
+        return res;
     }
+
+    res = pin_handle_change(handle, is_deletable, old, oldlen, new, newlen);
+    pin_close(handle);
+    return res;
 }
 
-uint32_t pin_delete(bool is_deletable)
+uint32_t pin_getsha256(bool is_deletable, uint8_t* buff, uint32_t len)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
-    TEEC_Operation op;
-    TEEC_UUID uuid = TA_PIN_UUID;
-    uint32_t err_origin;
-
-    /* Initialize a context connecting us to the TEE */
+    pin_handle_t* handle;
+    uint32_t res;
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    if (len != 32) {
+        return (uint32_t)-1;
+    }
 
+    res = pin_open(&handle);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08lx\n", res);
-        goto exit;
+        return res;
     }
 
-    /* Clear the TEEC_Operation struct */
-
-    memset(&op, 0, sizeof(op));
+    res = pin_handle_getsha256(handle, is_deletable, buff, len);
+    pin_close(handle);
+    return res;
+}
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+bool pin_is_exist(bool is_deletable)
+{
+    pin_handle_t* handle;
+    bool exist;
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_finalize;
+    if (pin_open(&handle) != TEEC_SUCCESS) {
+        return false;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-    op.params[0].value.a = is_deletable ? 1 : 0;
+    exist = pin_handle_is_exist(handle, is_deletable);
+    pin_close(handle);
+    return exist;
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_PIN_CMD_DEL, &op, &err_origin);
+uint32_t pin_delete(bool is_deletable)
+{
+    pin_handle_t* handle;
+    uint32_t res;
+
+    res = pin_open(&handle);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08lx origin 0x%08lx\n",
-            res, err_origin);
-        goto exit_close_session;
+        return res;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
+    res = pin_handle_delete(handle, is_deletable);
+    pin_close(handle);
     return res;
-}
\ No newline at end of file
+}
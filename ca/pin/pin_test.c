@@ -29,15 +29,16 @@ static void usage(void)
            "\tca_pin_test verify is_deletable pin\n"
            "\tca_pin_test change is_deletable old_pin new_pin\n"
            "\tca_pin_test hash is_deletable\n"
+           "\tca_pin_test unlock is_deletable pin\n"
            "\tExample: ca_pin_test store 0 123456\n");
 }
 
 int main(int argc, FAR char* argv[])
 {
     /*
-     * argv[1] : store/verify/change/hash
+     * argv[1] : store/verify/change/hash/unlock
      * argv[2] : 0(undeletable) 1(deletable)
-     * argv[3] : input PIN when store/verify
+     * argv[3] : input PIN when store/verify/unlock
      *           old PIN when change
      * argv[4] : new PIN when change
      */
@@ -64,6 +65,25 @@ int main(int argc, FAR char* argv[])
         } else {
             printf("verify failed.\n");
         }
+    } else if (strcmp(argv[1], "unlock") == 0 && argc == 4) {
+        /* check and verify through one session, as the lock screen does */
+
+        char* buff = argv[3];
+        pin_handle_t* handle;
+        if (pin_open(&handle) != 0) {
+            printf("open failed.\n");
+        } else {
+            if (pin_handle_is_exist(handle, is_deletable) == false) {
+                printf("pin is not existed.\n");
+            } else if (pin_handle_verify(handle, is_deletable, (uint8_t*)buff,
+                           strlen((const char*)buff))
+                == 0) {
+                printf("unlock successfully.\n");
+            } else {
+                printf("unlock failed.\n");
+            }
+            pin_close(handle);
+        }
     } else if (strcmp(argv[1], "change") == 0 && argc == 5) {
         char* old = argv[3];
         char* new = argv[4];
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <nuttx/config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee_client_api.h>
+#include <tee_shm_pool.h>
+#include <teec_trace.h>
+
+#define SLAB_DEDICATED (-1)
+
+static size_t class_size(int cls)
+{
+    return (size_t)TEE_SHM_POOL_MIN_CLASS << cls;
+}
+
+/* Reserve the region and lay the size classes out evenly in it */
+
+static TEEC_Result pool_setup(struct tee_shm_pool* pool)
+{
+    TEEC_Result res;
+    size_t share = CONFIG_CA_SHM_POOL_SIZE / TEE_SHM_POOL_CLASSES;
+    size_t base = 0;
+    int cls;
+
+    pool->region.size = CONFIG_CA_SHM_POOL_SIZE;
+    pool->region.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+    DMSG("TEEC_AllocateSharedMemory...\n");
+    res = TEEC_AllocateSharedMemory(pool->ctx, &pool->region);
+    if (res != TEEC_SUCCESS) {
+        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    for (cls = 0; cls < TEE_SHM_POOL_CLASSES; cls++) {
+        pool->nslots[cls] = share / class_size(cls);
+        if (pool->nslots[cls] > TEE_SHM_POOL_MAX_SLOTS) {
+            pool->nslots[cls] = TEE_SHM_POOL_MAX_SLOTS;
+        }
+
+        pool->base[cls] = base;
+        base += pool->nslots[cls] * class_size(cls);
+    }
+
+    pool->region_allocated = true;
+    pool->stats.size = CONFIG_CA_SHM_POOL_SIZE;
+    return TEEC_SUCCESS;
+}
+
+static TEEC_Result pool_alloc_dedicated(struct tee_shm_pool* pool,
+    size_t size, struct tee_shm_slab* slab)
+{
+    TEEC_Result res;
+    TEEC_SharedMemory* shm;
+
+    pool->stats.fallbacks++;
+    if (size > pool->stats.fallback_peak) {
+        pool->stats.fallback_peak = size;
+    }
+
+    if (pool->spare != NULL && pool->spare->size >= size) {
+        shm = pool->spare;
+        pool->spare = NULL;
+    } else {
+        shm = calloc(1, sizeof(*shm));
+        if (shm == NULL) {
+            return TEEC_ERROR_OUT_OF_MEMORY;
+        }
+
+        shm->size = size;
+        shm->flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+        DMSG("TEEC_AllocateSharedMemory...\n");
+        res = TEEC_AllocateSharedMemory(pool->ctx, shm);
+        if (res != TEEC_SUCCESS) {
+            EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
+            free(shm);
+            return res;
+        }
+    }
+
+    slab->shm = shm;
+    slab->offset = 0;
+    slab->size = shm->size;
+    slab->buffer = shm->buffer;
+    slab->cls = SLAB_DEDICATED;
+    slab->slot = 0;
+    return TEEC_SUCCESS;
+}
+
+static void pool_release_shm(TEEC_SharedMemory* shm)
+{
+    DMSG("TEEC_ReleaseSharedMemory...\n");
+    TEEC_ReleaseSharedMemory(shm);
+    free(shm);
+}
+
+void tee_shm_pool_init(struct tee_shm_pool* pool, TEEC_Context* ctx)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->ctx = ctx;
+}
+
+void tee_shm_pool_deinit(struct tee_shm_pool* pool)
+{
+    DMSG("shm pool: size %zu, peak %zu, allocs %" PRIu32 ", "
+         "fallbacks %" PRIu32 ", fallback peak %zu\n",
+        pool->stats.size, pool->stats.peak, pool->stats.allocs,
+        pool->stats.fallbacks, pool->stats.fallback_peak);
+
+    if (pool->spare != NULL) {
+        pool_release_shm(pool->spare);
+        pool->spare = NULL;
+    }
+
+    if (pool->region_allocated) {
+        DMSG("TEEC_ReleaseSharedMemory...\n");
+        TEEC_ReleaseSharedMemory(&pool->region);
+        pool->region_allocated = false;
+    }
+}
+
+TEEC_Result tee_shm_pool_alloc(struct tee_shm_pool* pool, size_t size,
+    struct tee_shm_slab* slab)
+{
+    TEEC_Result res;
+    int cls;
+    int slot;
+
+    if (size == 0) {
+        size = 1;
+    }
+
+    if (!pool->region_allocated) {
+        res = pool_setup(pool);
+        if (res != TEEC_SUCCESS) {
+            return pool_alloc_dedicated(pool, size, slab);
+        }
+    }
+
+    /* Take the first free slot of the smallest class that fits */
+
+    for (cls = 0; cls < TEE_SHM_POOL_CLASSES; cls++) {
+        if (class_size(cls) < size) {
+            continue;
+        }
+
+        for (slot = 0; slot < pool->nslots[cls]; slot++) {
+            if ((pool->busy[cls] & ((uint64_t)1 << slot)) == 0) {
+                break;
+            }
+        }
+
+        if (slot == pool->nslots[cls]) {
+            continue;
+        }
+
+        pool->busy[cls] |= (uint64_t)1 << slot;
+        pool->stats.allocs++;
+        pool->stats.cur += class_size(cls);
+        if (pool->stats.cur > pool->stats.peak) {
+            pool->stats.peak = pool->stats.cur;
+        }
+
+        slab->shm = &pool->region;
+        slab->offset = pool->base[cls] + slot * class_size(cls);
+        slab->size = class_size(cls);
+        slab->buffer = (uint8_t*)pool->region.buffer + slab->offset;
+        slab->cls = cls;
+        slab->slot = slot;
+        return TEEC_SUCCESS;
+    }
+
+    return pool_alloc_dedicated(pool, size, slab);
+}
+
+void tee_shm_pool_free(struct tee_shm_pool* pool, struct tee_shm_slab* slab)
+{
+    if (slab->shm == NULL) {
+        return;
+    }
+
+    if (slab->cls != SLAB_DEDICATED) {
+        pool->busy[slab->cls] &= ~((uint64_t)1 << slab->slot);
+        pool->stats.cur -= class_size(slab->cls);
+    } else if (pool->spare == NULL) {
+        pool->spare = slab->shm;
+    } else if (pool->spare->size < slab->shm->size) {
+        pool_release_shm(pool->spare);
+        pool->spare = slab->shm;
+    } else {
+        pool_release_shm(slab->shm);
+    }
+
+    slab->shm = NULL;
+}
+
+void tee_shm_pool_memref(const struct tee_shm_slab* slab, size_t size,
+    TEEC_Parameter* param)
+{
+    param->memref.parent = slab->shm;
+    param->memref.offset = slab->offset;
+    param->memref.size = size;
+}
+
+void tee_shm_pool_get_stats(struct tee_shm_pool* pool,
+    struct tee_shm_pool_stats* stats)
+{
+    *stats = pool->stats;
+}
@@ -16,415 +16,427 @@
 
 #include <fcntl.h>
 #include <nuttx/config.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <tee_client_api.h>
+#include <tee_shm_pool.h>
 #include <teec_trace.h>
 
+#include <triad_ca_api.h>
 #include <triad_ta.h>
 
-int triad_store_did(uint8_t* did, uint16_t len)
-{
-    TEEC_Result res = TEEC_ERROR_GENERIC;
+/*
+ * Every call goes through a client, the io buffers come from the shared
+ * memory pool of its context instead of being allocated one by one.
+ */
+
+struct triad_client {
     TEEC_Context ctx;
     TEEC_Session sess;
+    struct tee_shm_pool pool;
+};
+
+static TEEC_Result triad_client_open(struct triad_client* client)
+{
+    TEEC_Result res;
     TEEC_Operation op;
     TEEC_UUID uuid = TA_TRIAD_UUID;
-    TEEC_SharedMemory io_shm;
     uint32_t err_origin;
 
-    if (len != 8) {
-        goto exit;
-    }
-
     /* Initialize a context connecting us to the TEE */
 
     DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    res = TEEC_InitializeContext(NULL, &client->ctx);
 
     if (res != TEEC_SUCCESS) {
         EMSG("TEEC_InitializeContext failed with code 0x%08" PRIx32 "\n", res);
-        goto exit;
+        return res;
     }
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
-        goto exit_finalize;
-    }
-    memset(io_shm.buffer, 0, io_shm.size);
-    memcpy(io_shm.buffer, did, len);
-
     op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
         TEEC_NONE);
 
     DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
+    res = TEEC_OpenSession(&client->ctx, &client->sess, &uuid,
         TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
     if (res != TEEC_SUCCESS) {
         EMSG("TEEC_Opensession failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
             res, err_origin);
-        goto exit_free_mem;
+        DMSG("TEEC_FinalizeContext...\n");
+        TEEC_FinalizeContext(&client->ctx);
+        return res;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-    op.params[0].memref.parent = &io_shm;
+    tee_shm_pool_init(&client->pool, &client->ctx);
+    return TEEC_SUCCESS;
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_TRIAD_CMD_STORE_DID, &op,
-        &err_origin);
+static void triad_client_close(struct triad_client* client)
+{
+    DMSG("TEEC_CloseSession...\n");
+    TEEC_CloseSession(&client->sess);
+    tee_shm_pool_deinit(&client->pool);
+    DMSG("TEEC_FinalizeContext...\n");
+    TEEC_FinalizeContext(&client->ctx);
+}
+
+static TEEC_Result triad_client_invoke(struct triad_client* client,
+    uint32_t cmd, TEEC_Operation* op)
+{
+    TEEC_Result res;
+    uint32_t err_origin;
+
+    res = TEEC_InvokeCommand(&client->sess, cmd, op, &err_origin);
     if (res != TEEC_SUCCESS) {
         EMSG("TEEC_InvokeCommand failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
             res, err_origin);
-        goto exit_close_session;
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
     return res;
 }
 
-int triad_load_did(uint8_t* did, uint16_t len)
+/*
+ * Send the len bytes of buff to cmd, or get len bytes from cmd into buff
+ * when is_output is set.
+ */
+
+static TEEC_Result triad_transfer(uint32_t cmd, uint8_t* buff, uint16_t len,
+    bool is_output)
 {
-    TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
+    TEEC_Result res;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_TRIAD_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    struct triad_client client;
+    struct tee_shm_slab io_shm;
 
-    if (len != 8) {
-        goto exit;
+    res = triad_client_open(&client);
+    if (res != TEEC_SUCCESS) {
+        return res;
     }
 
-    /* Initialize a context connecting us to the TEE */
-
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
-
+    res = tee_shm_pool_alloc(&client.pool, len, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08" PRIx32 "\n", res);
-        goto exit;
+        goto exit_close;
+    }
+
+    if (is_output) {
+        memset(io_shm.buffer, 0, len);
+    } else {
+        memcpy(io_shm.buffer, buff, len);
     }
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_OUTPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
-        goto exit_finalize;
+    op.paramTypes = TEEC_PARAM_TYPES(is_output ? TEEC_MEMREF_PARTIAL_OUTPUT
+                                               : TEEC_MEMREF_PARTIAL_INPUT,
+        TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    tee_shm_pool_memref(&io_shm, len, &op.params[0]);
+
+    res = triad_client_invoke(&client, cmd, &op);
+    if (res == TEEC_SUCCESS && is_output) {
+        memcpy(buff, io_shm.buffer, len);
     }
-    memset(io_shm.buffer, 0, io_shm.size);
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+    tee_shm_pool_free(&client.pool, &io_shm);
+exit_close:
+    triad_client_close(&client);
+    return res;
+}
 
-    /*
-     * Open a session to the "hello world" TA, the TA will print "hello
-     * world!" in the log when the session is created.
-     */
+int triad_store_did(uint8_t* did, uint16_t len)
+{
+    if (len != 8) {
+        return TEEC_ERROR_GENERIC;
+    }
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_free_mem;
+    return triad_transfer(TA_TRIAD_CMD_STORE_DID, did, len, false);
+}
+
+int triad_load_did(uint8_t* did, uint16_t len)
+{
+    if (len != 8) {
+        return TEEC_ERROR_GENERIC;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_NONE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].memref.parent = &io_shm;
+    return triad_transfer(TA_TRIAD_CMD_LOAD_DID, did, len, true);
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_TRIAD_CMD_LOAD_DID, &op,
-        &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_close_session;
+int triad_store_key(uint8_t* key, uint16_t len)
+{
+    if (len != 16) {
+        return TEEC_ERROR_GENERIC;
     }
 
-    memcpy(did, io_shm.buffer, len);
+    return triad_transfer(TA_TRIAD_CMD_STORE_KEY, key, len, false);
+}
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
-exit:
-    return res;
+int triad_load_key(uint8_t* key, uint16_t len)
+{
+    if (len != 16) {
+        return TEEC_ERROR_GENERIC;
+    }
+
+    return triad_transfer(TA_TRIAD_CMD_LOAD_KEY, key, len, true);
 }
 
-int triad_store_key(uint8_t* key, uint16_t len)
+int triad_get_hmac(uint8_t* input, uint16_t inlen,
+    uint8_t* output, uint16_t outlen)
 {
     TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_TRIAD_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    struct triad_client client;
+    struct tee_shm_slab io_shm;
+    size_t size;
 
-    if (len != 16) {
+    if (inlen == 0 || outlen != 32) {
         goto exit;
     }
 
-    /* Initialize a context connecting us to the TEE */
-
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
-
+    res = triad_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08" PRIx32 "\n", res);
         goto exit;
     }
 
-    /* Clear the TEEC_Operation struct */
+    /* The hmac is written back over the input */
 
-    memset(&op, 0, sizeof(op));
-
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_INPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    size = inlen < 32 ? 32 : inlen;
+    res = tee_shm_pool_alloc(&client.pool, size, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
-        goto exit_finalize;
+        goto exit_close;
     }
-    memset(io_shm.buffer, 0, io_shm.size);
-    memcpy(io_shm.buffer, key, len);
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+    memset(io_shm.buffer, 0, size);
+    memcpy(io_shm.buffer, input, inlen);
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_free_mem;
-    }
+    /* Clear the TEEC_Operation struct */
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-    op.params[0].memref.parent = &io_shm;
+    memset(&op, 0, sizeof(op));
 
-    res = TEEC_InvokeCommand(&sess, TA_TRIAD_CMD_STORE_KEY, &op,
-        &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_close_session;
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INOUT,
+        TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+    tee_shm_pool_memref(&io_shm, size, &op.params[0]);
+    op.params[1].value.a = inlen;
+
+    res = triad_client_invoke(&client, TA_TRIAD_CMD_GET_HMAC, &op);
+    if (res == TEEC_SUCCESS) {
+        memcpy(output, io_shm.buffer, 32);
     }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
+    tee_shm_pool_free(&client.pool, &io_shm);
+exit_close:
+    triad_client_close(&client);
 exit:
     return res;
 }
 
-int triad_load_key(uint8_t* key, uint16_t len)
+int triad_get_hmac_batch(const uint8_t* const* inputs,
+    const uint32_t* inlens, uint32_t count, uint8_t* output,
+    uint32_t outlen)
 {
     TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_TRIAD_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    struct triad_client client;
+    struct tee_shm_slab io_shm;
+    uint8_t* p;
+    size_t inlen = 0;
+    uint32_t i;
+
+    if (inputs == NULL || inlens == NULL || output == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
 
-    if (len != 16) {
+    if (count == 0 || outlen / 32 < count) {
         goto exit;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    /* The records and the hmacs must fit in one buffer */
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    for (i = 0; i < count; i++) {
+        if ((inputs[i] == NULL && inlens[i] > 0)
+            || inlens[i] > SIZE_MAX - sizeof(uint32_t) - inlen) {
+            return TEEC_ERROR_BAD_PARAMETERS;
+        }
 
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08" PRIx32 "\n", res);
-        goto exit;
+        inlen += sizeof(uint32_t) + inlens[i];
     }
 
-    /* Clear the TEEC_Operation struct */
-
-    memset(&op, 0, sizeof(op));
+    if (inlen > SIZE_MAX - 32 * (size_t)count) {
+        return TEEC_ERROR_BAD_PARAMETERS;
+    }
 
-    io_shm.size = len;
-    io_shm.flags = TEEC_MEM_OUTPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = triad_client_open(&client);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
-        goto exit_finalize;
+        goto exit;
     }
-    memset(io_shm.buffer, 0, io_shm.size);
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
-
-    /*
-     * Open a session to the "hello world" TA, the TA will print "hello
-     * world!" in the log when the session is created.
-     */
+    /* The packed records are followed by room for the hmacs */
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
+    res = tee_shm_pool_alloc(&client.pool, inlen + 32 * count, &io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_free_mem;
+        goto exit_close;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_NONE,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].memref.parent = &io_shm;
-
-    res = TEEC_InvokeCommand(&sess, TA_TRIAD_CMD_LOAD_KEY, &op,
-        &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_close_session;
+    p = io_shm.buffer;
+    for (i = 0; i < count; i++) {
+        memcpy(p, &inlens[i], sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        memcpy(p, inputs[i], inlens[i]);
+        p += inlens[i];
     }
 
-    memcpy(key, io_shm.buffer, len);
+    /* Clear the TEEC_Operation struct */
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,
+        TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_VALUE_INPUT, TEEC_NONE);
+    tee_shm_pool_memref(&io_shm, inlen, &op.params[0]);
+    tee_shm_pool_memref(&io_shm, inlen + 32 * count, &op.params[1]);
+    op.params[1].memref.offset += inlen;
+    op.params[1].memref.size = 32 * count;
+    op.params[2].value.a = count;
+
+    res = triad_client_invoke(&client, TA_TRIAD_CMD_GET_HMAC_BATCH, &op);
+    if (res == TEEC_SUCCESS) {
+        memcpy(output, (uint8_t*)io_shm.buffer + inlen, 32 * count);
+    }
+
+    tee_shm_pool_free(&client.pool, &io_shm);
+exit_close:
+    triad_client_close(&client);
 exit:
     return res;
 }
 
-int triad_get_hmac(uint8_t* input, uint16_t inlen,
-    uint8_t* output, uint16_t outlen)
+struct triad_hmac_ctx {
+    struct triad_client client;
+    struct tee_shm_slab io_shm;
+};
+
+int triad_hmac_init(triad_hmac_ctx_t** hctx)
 {
     TEEC_Result res = TEEC_ERROR_GENERIC;
-    TEEC_Context ctx;
-    TEEC_Session sess;
     TEEC_Operation op;
-    TEEC_UUID uuid = TA_TRIAD_UUID;
-    TEEC_SharedMemory io_shm;
-    uint32_t err_origin;
+    triad_hmac_ctx_t* h;
 
-    if (inlen == 0 || outlen != 32) {
-        goto exit;
+    if (hctx == NULL) {
+        return TEEC_ERROR_BAD_PARAMETERS;
     }
 
-    /* Initialize a context connecting us to the TEE */
+    h = malloc(sizeof(*h));
+    if (h == NULL) {
+        return TEEC_ERROR_OUT_OF_MEMORY;
+    }
 
-    DMSG("TEEC_InitializeContext...\n");
-    res = TEEC_InitializeContext(NULL, &ctx);
+    res = triad_client_open(&h->client);
+    if (res != TEEC_SUCCESS) {
+        goto exit_free;
+    }
 
+    /*
+     * All the chunks go through this one buffer, the memory used does not
+     * depend on the length of the data
+     */
+
+    res = tee_shm_pool_alloc(&h->client.pool, CONFIG_CA_TRIAD_HMAC_CHUNK_SIZE,
+        &h->io_shm);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InitializeContext failed with code 0x%08" PRIx32 "\n", res);
-        goto exit;
+        goto exit_close;
     }
 
     /* Clear the TEEC_Operation struct */
 
     memset(&op, 0, sizeof(op));
 
-    if (inlen < 32)
-        io_shm.size = 32;
-    else
-        io_shm.size = inlen;
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE, TEEC_NONE,
+        TEEC_NONE);
 
-    io_shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
-    DMSG("TEEC_AllocateSharedMemory...\n");
-    res = TEEC_AllocateSharedMemory(&ctx, &io_shm);
+    res = triad_client_invoke(&h->client, TA_TRIAD_CMD_HMAC_INIT, &op);
     if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_AllocateSharedMemory failed with code 0x%08" PRIx32 "\n", res);
-        goto exit_finalize;
+        goto exit_free_mem;
     }
 
-    memset(io_shm.buffer, 0, io_shm.size);
-    memcpy(io_shm.buffer, input, inlen);
+    *hctx = h;
+    return TEEC_SUCCESS;
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE,
-        TEEC_NONE);
+exit_free_mem:
+    tee_shm_pool_free(&h->client.pool, &h->io_shm);
+exit_close:
+    triad_client_close(&h->client);
+exit_free:
+    free(h);
+    return res;
+}
 
-    /*
-     * Open a session to the "hello world" TA, the TA will print "hello
-     * world!" in the log when the session is created.
-     */
+int triad_hmac_update(triad_hmac_ctx_t* hctx, const uint8_t* input,
+    uint32_t inlen)
+{
+    TEEC_Result res = TEEC_SUCCESS;
+    TEEC_Operation op;
+    uint32_t chunk;
 
-    DMSG("TEEC_OpenSession...\n");
-    res = TEEC_OpenSession(&ctx, &sess, &uuid,
-        TEEC_LOGIN_PUBLIC, NULL, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_Opensession failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_free_mem;
+    while (inlen > 0) {
+        chunk = inlen < CONFIG_CA_TRIAD_HMAC_CHUNK_SIZE
+            ? inlen
+            : CONFIG_CA_TRIAD_HMAC_CHUNK_SIZE;
+        memcpy(hctx->io_shm.buffer, input, chunk);
+
+        /* Clear the TEEC_Operation struct */
+
+        memset(&op, 0, sizeof(op));
+
+        op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE,
+            TEEC_NONE, TEEC_NONE);
+        tee_shm_pool_memref(&hctx->io_shm, chunk, &op.params[0]);
+
+        res = triad_client_invoke(&hctx->client, TA_TRIAD_CMD_HMAC_UPDATE,
+            &op);
+        if (res != TEEC_SUCCESS) {
+            break;
+        }
+
+        input += chunk;
+        inlen -= chunk;
     }
 
-    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_VALUE_INPUT,
-        TEEC_NONE, TEEC_NONE);
-    op.params[0].memref.parent = &io_shm;
-    op.params[1].value.a = inlen;
+    return res;
+}
 
-    res = TEEC_InvokeCommand(&sess, TA_TRIAD_CMD_GET_HMAC, &op, &err_origin);
-    if (res != TEEC_SUCCESS) {
-        EMSG("TEEC_InvokeCommand failed with code 0x%08" PRIx32 " origin 0x%08" PRIx32 "\n",
-            res, err_origin);
-        goto exit_close_session;
+int triad_hmac_final(triad_hmac_ctx_t* hctx, uint8_t* output,
+    uint16_t outlen)
+{
+    TEEC_Result res = TEEC_ERROR_GENERIC;
+    TEEC_Operation op;
+
+    if (output == NULL || outlen != 32) {
+        goto exit;
     }
 
-    memcpy(output, io_shm.buffer, 32);
+    /* Clear the TEEC_Operation struct */
+
+    memset(&op, 0, sizeof(op));
+
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
+        TEEC_NONE, TEEC_NONE);
+    tee_shm_pool_memref(&hctx->io_shm, 32, &op.params[0]);
+
+    res = triad_client_invoke(&hctx->client, TA_TRIAD_CMD_HMAC_FINAL, &op);
+    if (res == TEEC_SUCCESS) {
+        memcpy(output, hctx->io_shm.buffer, 32);
+    }
 
-exit_close_session:
-    DMSG("TEEC_CloseSession...\n");
-    TEEC_CloseSession(&sess);
-exit_free_mem:
-    DMSG("TEEC_ReleaseSharedMemory...\n");
-    TEEC_ReleaseSharedMemory(&io_shm);
-exit_finalize:
-    DMSG("TEEC_FinalizeContext...\n");
-    TEEC_FinalizeContext(&ctx);
 exit:
+    tee_shm_pool_free(&hctx->client.pool, &hctx->io_shm);
+    triad_client_close(&hctx->client);
+    free(hctx);
     return res;
-}
\ No newline at end of file
+}
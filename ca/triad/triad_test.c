@@ -14,15 +14,18 @@
  * limitations under the License.
  */
 
+#include <nuttx/clock.h>
 #include <nuttx/config.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <triad_ca_api.h>
 
 #define TRIAD_DID_SIZE 8
 #define TRIAD_KEY_SIZE 16
 #define TRIAD_HMAC_SIZE 32
+#define TRIAD_BENCH_RECORDS 100
 
 static const uint8_t test_key[16] = {
     0x46, 0x78, 0x5A, 0x43, 0x30, 0x76, 0x55, 0x78,
@@ -50,13 +53,68 @@ static void usage(void)
 {
     printf("usage:\n"
            "\tca_triad_test \n"
-           "\tca_triad_test store\n");
+           "\tca_triad_test store\n"
+           "\tca_triad_test bench\n");
+}
+
+/* Sign the same records one call each and then in one batch */
+
+static int hmac_bench(void)
+{
+    static uint8_t batch_hmac[TRIAD_BENCH_RECORDS * TRIAD_HMAC_SIZE];
+    const uint8_t* inputs[TRIAD_BENCH_RECORDS];
+    uint32_t inlens[TRIAD_BENCH_RECORDS];
+    uint32_t single_ms;
+    uint32_t batch_ms;
+    clock_t start;
+    int i;
+
+    for (i = 0; i < TRIAD_BENCH_RECORDS; i++) {
+        inputs[i] = txt;
+        inlens[i] = 1 + i % sizeof(txt);
+    }
+
+    start = clock();
+    for (i = 0; i < TRIAD_BENCH_RECORDS; i++) {
+        if (triad_get_hmac((uint8_t*)inputs[i], inlens[i], hmac,
+                TRIAD_HMAC_SIZE)
+            != 0) {
+            printf("triad get hmac fail\n");
+            return -1;
+        }
+    }
+
+    single_ms = (uint32_t)TICK2MSEC(clock() - start);
+
+    start = clock();
+    if (triad_get_hmac_batch(inputs, inlens, TRIAD_BENCH_RECORDS, batch_hmac,
+            sizeof(batch_hmac))
+        != 0) {
+        printf("triad get hmac batch fail\n");
+        return -1;
+    }
+
+    batch_ms = (uint32_t)TICK2MSEC(clock() - start);
+
+    /* the last single call signed the last record */
+
+    if (memcmp(hmac, batch_hmac + (TRIAD_BENCH_RECORDS - 1) * TRIAD_HMAC_SIZE,
+            TRIAD_HMAC_SIZE)
+        != 0) {
+        printf("batch hmac mismatch\n");
+        return -1;
+    }
+
+    printf("%d records, single: %" PRIu32 " ms, batch: %" PRIu32 " ms\n",
+        TRIAD_BENCH_RECORDS, single_ms, batch_ms);
+    return 0;
 }
 
 int main(int argc, FAR char* argv[])
 {
     /*
      * argv[1] : store (overwrite triad when reading a triple fails)
+     *           bench (compare single and batch hmac)
      */
 
     if (argc != 1 && argc != 2) {
@@ -69,6 +127,8 @@ int main(int argc, FAR char* argv[])
     if (argc == 2) {
         if (strcmp(argv[1], "store") == 0) {
             store = true;
+        } else if (strcmp(argv[1], "bench") == 0) {
+            return hmac_bench();
         } else {
             printf("Unrecognized option: %s\n", argv[1]);
             usage();
@@ -124,6 +184,42 @@ int main(int argc, FAR char* argv[])
         printf("triad get hmac fail\n");
         res = -1;
     }
+    const uint8_t* inputs[2] = { txt, txt };
+    uint32_t inlens[2] = { 30, sizeof(txt) };
+    uint8_t batch_hmac[2 * TRIAD_HMAC_SIZE];
+
+    if (triad_get_hmac_batch(inputs, inlens, 2, batch_hmac,
+            sizeof(batch_hmac))
+            == 0
+        && memcmp(batch_hmac + TRIAD_HMAC_SIZE, hmac, TRIAD_HMAC_SIZE) == 0) {
+        printf("batch hmac ok\n");
+    } else {
+        printf("triad batch hmac fail\n");
+        res = -1;
+    }
+
+    triad_hmac_ctx_t* hctx;
+    uint8_t stream_hmac[TRIAD_HMAC_SIZE];
+
+    if (triad_hmac_init(&hctx) == 0) {
+        int ret = triad_hmac_update(hctx, txt, 30);
+        if (ret == 0) {
+            ret = triad_hmac_update(hctx, txt + 30, sizeof(txt) - 30);
+        }
+
+        /* final releases the context, so always call it */
+
+        if (triad_hmac_final(hctx, stream_hmac, TRIAD_HMAC_SIZE) == 0
+            && ret == 0 && memcmp(stream_hmac, hmac, TRIAD_HMAC_SIZE) == 0) {
+            printf("stream hmac ok\n");
+        } else {
+            printf("triad stream hmac fail\n");
+            res = -1;
+        }
+    } else {
+        printf("triad stream hmac init fail\n");
+        res = -1;
+    }
     printf("end main\n");
 
     return res;
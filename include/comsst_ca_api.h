@@ -19,11 +19,41 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <tee_shm_pool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * The comsst data may be kept in the cache of the calling process, see
+ * comsst_data_read_ex(). Never set it for secrets.
+ */
+
+#define COMSST_FLAG_CACHEABLE (1 << 0)
+
+/*
+ * The comsst data is compressed by the TA whatever its size, if the TA
+ * is built with CONFIG_TA_COMSST_COMPRESS. Only writes look at it.
+ */
+
+#define COMSST_FLAG_COMPRESS (1 << 1)
+
+/* Length of the SHA-256 digest of comsst data, see comsst_data_digest() */
+
+#define COMSST_DIGEST_LEN 32
+
+/**
+ * @brief counters of the comsst cache of the calling process
+ */
+struct comsst_cache_stats {
+    uint32_t hits; /* reads served from the cache */
+    uint32_t misses; /* reads that went to the TA */
+    uint32_t evictions; /* items dropped to make room */
+    uint32_t entries; /* items in the cache right now */
+    uint32_t bytes; /* bytes of comsst data in the cache right now */
+};
+
 /**
  * @brief to read the comsst data from secure storage
  *
@@ -31,12 +61,16 @@ extern "C" {
  * @param[in]  name         the name of comsst data to fetch
  *                          in underlying implementation, the comsst
  *                          name is constructed by scope and name,
- *                          and the max length of "scope + name" is 30
+ *                          and the max length of "scope + name" is 64,
+ *                          or COMSST_NAME_MAX if the TA hashes the IDs
  * @param[in]  is_deletable to indicate the comsst to fetch is stored on
  *                          deleteable area or non-deletable area
  * @param[out] buff         the buffer to contain the comsst data that
  *                          is fetched from secure storage
- * @param[out] out_len      the length of the comsst data that is fetched
+ * @param[in,out] out_len  the size of buff on input, the length of the
+ *                          comsst data that is fetched on output. If buff
+ *                          is too small TEEC_ERROR_SHORT_BUFFER is
+ *                          returned and out_len is set to the size needed
  * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
  */
 uint32_t comsst_data_read(uint8_t* scope, uint8_t* name, bool is_deletable,
@@ -49,7 +83,8 @@ uint32_t comsst_data_read(uint8_t* scope, uint8_t* name, bool is_deletable,
  * @param[in]  name        the name of comsst data to fetch
  *                         in underlying implementation, the comsst
  *                         name is constructed by scope and name,
- *                         and the max length of "scope + name" is 30
+ *                         and the max length of "scope + name" is 64,
+ *                         or COMSST_NAME_MAX if the TA hashes the IDs
  * @param[in] is_deletable to indicate the comsst to write is stored on
  *                         deleteable area or non-deletable area
  * @param[in] buff         the buffer contains the comsst data to write
@@ -66,7 +101,8 @@ uint32_t comsst_data_write(uint8_t* scope, uint8_t* name, bool is_deletable,
  * @param[in]  name        the name of comsst data to fetch
  *                         in underlying implementation, the comsst
  *                         name is constructed by scope and name,
- *                         and the max length of "scope + name" is 30
+ *                         and the max length of "scope + name" is 64,
+ *                         or COMSST_NAME_MAX if the TA hashes the IDs
  * @param[in] is_deletable to indicate the comsst to delete is stored on
  *                         deleteable area or non-deletable area
  * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
@@ -80,7 +116,8 @@ uint32_t comsst_data_delete(uint8_t* scope, uint8_t* name, bool is_deletable);
  * @param[in]  name        the name of comsst data to fetch
  *                         in underlying implementation, the comsst
  *                         name is constructed by scope and name,
- *                         and the max length of "scope + name" is 30
+ *                         and the max length of "scope + name" is 64,
+ *                         or COMSST_NAME_MAX if the TA hashes the IDs
  * @param[in] is_deletable to indicate the comsst to check is stored on
  *                         deleteable area or non-deletable area
  * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
@@ -96,7 +133,8 @@ uint32_t is_comsst_data_exited(uint8_t* scope, uint8_t* name,
  * @param[in]  name        the name of comsst data to fetch
  *                         in underlying implementation, the comsst
  *                         name is constructed by scope and name,
- *                         and the max length of "scope + name" is 30
+ *                         and the max length of "scope + name" is 64,
+ *                         or COMSST_NAME_MAX if the TA hashes the IDs
  * @param[in] is_deletable to indicate the comsst to verify is stored on
  *                         deleteable area or non-deletable area
  * @param[in] buff         the buffer contains the data to verify
@@ -106,6 +144,741 @@ uint32_t is_comsst_data_exited(uint8_t* scope, uint8_t* name,
 uint32_t comsst_data_verify(uint8_t* scope, uint8_t* name, bool is_deletable,
     uint8_t* buff, uint32_t len);
 
+/**
+ * @brief same as comsst_data_verify(), but given the SHA-256 digest of the
+ *        data to verify instead of the data
+ * @param[in] digest the SHA-256 digest of the data to verify
+ */
+uint32_t comsst_data_verify_digest(uint8_t* scope, uint8_t* name,
+    bool is_deletable, const uint8_t digest[COMSST_DIGEST_LEN]);
+
+/**
+ * @brief to get the SHA-256 digest of the comsst data without reading it.
+ *        The TA keeps the digest of every comsst data it writes, so the
+ *        cost does not depend on the length of the comsst data, except
+ *        once after it was written in chunks or patched.
+ * @param[in]  scope        the scope the comsst data to query
+ * @param[in]  name         the name of comsst data to query
+ * @param[in]  is_deletable to indicate the comsst to query is stored on
+ *                          deleteable area or non-deletable area
+ * @param[out] digest       the SHA-256 digest of the comsst data
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_digest(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint8_t digest[COMSST_DIGEST_LEN]);
+
+/**
+ * @brief to write the comsst data only if it still holds the expected
+ *        data, checked and written by the TA in a single invocation. A
+ *        read-modify-write loop on it needs no lock between processes.
+ * @param[in] scope        the scope the comsst data to write
+ * @param[in] name         the name of comsst data to write
+ * @param[in] is_deletable to indicate the comsst to write is stored on
+ *                         deleteable area or non-deletable area
+ * @param[in] expected     the data the comsst data is expected to hold,
+ *                         NULL if it is expected not to exist
+ * @param[in] expected_len the length of expected
+ * @param[in] buff         the buffer contains the comsst data to write
+ * @param[in] len          the length of the comsst data to write
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_ACCESS_CONFLICT if the
+ *         comsst data is not as expected, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_cas(uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t* expected, uint32_t expected_len, uint8_t* buff,
+    uint32_t len);
+
+/**
+ * @brief same as comsst_data_cas(), but given the SHA-256 digest of the
+ *        expected data, e.g. from comsst_data_digest(), or NULL
+ */
+uint32_t comsst_data_cas_digest(uint8_t* scope, uint8_t* name,
+    bool is_deletable, const uint8_t expected[COMSST_DIGEST_LEN],
+    uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as comsst_data_read(), but the TA writes the data straight
+ *        into buff instead of a shared memory buffer that is copied out
+ *        afterwards. Falls back to comsst_data_read() if buff can not be
+ *        registered as shared memory. TEEC_ERROR_SHORT_BUFFER is returned
+ *        and *out_len is set to the length of the item if buff is too
+ *        small to hold it.
+ */
+uint32_t comsst_data_read_direct(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t* out_len);
+
+/**
+ * @brief same as comsst_data_write(), but the TA reads the data straight
+ *        from buff instead of a copy in shared memory. Falls back to
+ *        comsst_data_write() if buff can not be registered as shared
+ *        memory.
+ */
+uint32_t comsst_data_write_direct(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as comsst_data_read(), but the comsst data is kept in the
+ *        cache of the calling process if COMSST_FLAG_CACHEABLE is set.
+ *        Every read looks the cache up first, whatever the flags are. The
+ *        cache is only kept coherent with the writes of this process, so
+ *        only mark comsst data that no other process changes.
+ *
+ * @param[in] flags COMSST_FLAG_* values
+ */
+uint32_t comsst_data_read_ex(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t* out_len, uint32_t flags);
+
+/**
+ * @brief same as comsst_data_write(), the cached copy of the comsst data
+ *        is replaced with the new one if COMSST_FLAG_CACHEABLE is set and
+ *        dropped otherwise. COMSST_FLAG_COMPRESS asks the TA to compress
+ *        it.
+ *
+ * @param[in] flags COMSST_FLAG_* values
+ */
+uint32_t comsst_data_write_ex(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, uint32_t flags);
+
+/**
+ * @brief get the counters of the comsst cache of the calling process, it
+ *        holds at most CONFIG_CA_COMSST_CACHE_SIZE bytes
+ *
+ * @param[out] stats the counters
+ */
+void comsst_cache_get_stats(struct comsst_cache_stats* stats);
+
+/**
+ * @brief drop everything from the comsst cache of the calling process
+ */
+void comsst_cache_flush(void);
+
+/**
+ * @brief to get the size and the flags of the comsst data without reading
+ *        it
+ *
+ * @param[in]  scope        the scope the comsst data to query
+ * @param[in]  name         the name of comsst data to query
+ *                          in underlying implementation, the comsst
+ *                          name is constructed by scope and name,
+ *                          and the max length of "scope + name" is 64,
+ *                          or COMSST_NAME_MAX if the TA hashes the IDs
+ * @param[in]  is_deletable to indicate the comsst to query is stored on
+ *                          deleteable area or non-deletable area
+ * @param[out] size         the length of the comsst data, may be NULL
+ * @param[out] flags        the TEE_DATA_FLAG_* / TEE_HANDLE_FLAG_* of the
+ *                          object holding the comsst data, may be NULL
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_stat(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint32_t* size, uint32_t* flags);
+
+/**
+ * @brief same as comsst_data_read(), but the buffer is allocated to the
+ *        exact size of the comsst data
+ *
+ * @param[in]  scope        the scope the comsst data to fetch
+ * @param[in]  name         the name of comsst data to fetch
+ * @param[in]  is_deletable to indicate the comsst to fetch is stored on
+ *                          deleteable area or non-deletable area
+ * @param[out] buff         the comsst data, release it with free()
+ * @param[out] out_len      the length of the comsst data
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_read_alloc(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t** buff, uint32_t* out_len);
+
+/**
+ * @brief to update part of the comsst data in place, only the bytes given
+ *        are sent to the TA and written to storage
+ *
+ * @param[in] scope        the scope the comsst data to update
+ * @param[in] name         the name of comsst data to update
+ * @param[in] is_deletable to indicate the comsst to update is stored on
+ *                         deleteable area or non-deletable area
+ * @param[in] offset       where to write buff in the comsst data, the
+ *                         comsst data is extended with zeros if it is
+ *                         past its end
+ * @param[in] buff         the bytes to write, may be NULL if len is 0
+ * @param[in] len          the number of bytes to write
+ * @param[in] truncate     make the comsst data end at offset + len,
+ *                         otherwise the bytes after it are kept
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_ITEM_NOT_FOUND if the comsst
+ *         data does not exist, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_patch(uint8_t* scope, uint8_t* name, bool is_deletable,
+    uint32_t offset, uint8_t* buff, uint32_t len, bool truncate);
+
+/**
+ * @brief called by comsst_list() for every comsst data found, name is not
+ *        NUL terminated and is only valid during the call
+ */
+typedef void (*comsst_list_cb_t)(const uint8_t* name, uint32_t len,
+    void* priv);
+
+/**
+ * @brief to list the names of the comsst data stored under a scope
+ *
+ * @param[in] scope        the scope to list, every comsst data whose
+ *                         "scope + name" starts with it is returned
+ * @param[in] is_deletable to indicate to list the deleteable area or the
+ *                         non-deletable area
+ * @param[in] cb           called with the name of every comsst data found,
+ *                         the scope is not part of it
+ * @param[in] priv         passed to cb as is
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_list(uint8_t* scope, bool is_deletable, comsst_list_cb_t cb,
+    void* priv);
+
+/**
+ * @brief to delete all the comsst data stored under a scope with a single
+ *        TEE invocation
+ *
+ * @param[in]  scope        the scope to clear, every comsst data whose
+ *                          "scope + name" starts with it is deleted. It
+ *                          must not be empty.
+ * @param[in]  is_deletable to indicate to clear the deleteable area or the
+ *                          non-deletable area
+ * @param[out] count        the number of comsst data deleted, may be NULL
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_scope_clear(uint8_t* scope, bool is_deletable,
+    uint32_t* count);
+
+/**
+ * @brief called by comsst_data_read_stream() with every piece of the
+ *        comsst data in order, return non-zero to stop reading
+ */
+typedef int (*comsst_stream_sink_t)(const uint8_t* buff, uint32_t len,
+    void* priv);
+
+/**
+ * @brief called by comsst_data_write_stream() to get the next piece of the
+ *        comsst data. Fill buff with at most len bytes and return the
+ *        number of bytes filled, 0 at the end of the data or a negative
+ *        value to stop writing.
+ */
+typedef int32_t (*comsst_stream_source_t)(uint8_t* buff, uint32_t len,
+    void* priv);
+
+/**
+ * @brief to read the comsst data piece by piece through a shared memory
+ *        window of CONFIG_CA_COMSST_STREAM_WINDOW bytes, whatever the size
+ *        of the comsst data is
+ *
+ * @param[in] scope        the scope the comsst data to fetch
+ * @param[in] name         the name of comsst data to fetch
+ * @param[in] is_deletable to indicate the comsst to fetch is stored on
+ *                         deleteable area or non-deletable area
+ * @param[in] sink         called with every piece that is read
+ * @param[in] priv         passed to sink as is
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_CANCEL if sink stopped the
+ *         read, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_read_stream(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_stream_sink_t sink, void* priv);
+
+/**
+ * @brief to write the comsst data piece by piece through a shared memory
+ *        window of CONFIG_CA_COMSST_STREAM_WINDOW bytes. The comsst data
+ *        is replaced by what source returns. It is not written atomically,
+ *        a reader may see part of it until the stream ends.
+ *
+ * @param[in] scope        the scope the comsst data to write
+ * @param[in] name         the name of comsst data to write
+ * @param[in] is_deletable to indicate the comsst to write is stored on
+ *                         deleteable area or non-deletable area
+ * @param[in] source       called to get every piece to write
+ * @param[in] priv         passed to source as is
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_CANCEL if source stopped the
+ *         write, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_data_write_stream(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_stream_source_t source, void* priv);
+
+/**
+ * @brief opaque comsst client, it holds one TEE context, one session to
+ *        the comsst TA and a pool of shared memory that is reused by
+ *        every call, so that a series of comsst operations only pays the
+ *        setup once. The session is reopened transparently when the
+ *        TA instance behind it has died. A client must not be used by
+ *        more than one thread at the same time.
+ */
+typedef struct comsst_client comsst_client_t;
+
+/**
+ * @brief open a comsst client
+ *
+ * @param[out] client the opened client, release it with comsst_client_close()
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_client_open(comsst_client_t** client);
+
+/**
+ * @brief close the session, shared memory and context held by the client
+ *        and free it
+ *
+ * @param[in] client the client returned by comsst_client_open()
+ */
+void comsst_client_close(comsst_client_t* client);
+
+/**
+ * @brief get the usage of the shared memory pool of the client
+ *
+ * @param[in]  client the client returned by comsst_client_open()
+ * @param[out] stats  the usage of the shared memory pool
+ */
+void comsst_client_get_shm_stats(comsst_client_t* client,
+    struct tee_shm_pool_stats* stats);
+
+/**
+ * @brief same as comsst_data_read(), but use the session held by the
+ *        client. TEEC_ERROR_SHORT_BUFFER is returned and *out_len is set
+ *        to the length of the item if buff is too small to hold it.
+ */
+uint32_t comsst_client_data_read(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len);
+
+/**
+ * @brief same as comsst_data_write(), but use the session held by the client
+ */
+uint32_t comsst_client_data_write(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as comsst_data_read_ex(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_read_ex(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t* out_len,
+    uint32_t flags);
+
+/**
+ * @brief same as comsst_data_write_ex(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_write_ex(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len, uint32_t flags);
+
+/**
+ * @brief same as comsst_data_delete(), but use the session held by the client
+ */
+uint32_t comsst_client_data_delete(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+/**
+ * @brief same as is_comsst_data_exited(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_check(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+/**
+ * @brief same as comsst_data_verify(), but use the session held by the client
+ */
+uint32_t comsst_client_data_verify(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as comsst_data_verify_digest(), but use the session held by
+ *        the client
+ */
+uint32_t comsst_client_data_verify_digest(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t digest[COMSST_DIGEST_LEN]);
+
+/**
+ * @brief same as comsst_data_digest(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_digest(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t digest[COMSST_DIGEST_LEN]);
+
+/**
+ * @brief same as comsst_data_cas(), but use the session held by the client
+ */
+uint32_t comsst_client_data_cas(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, const uint8_t* expected,
+    uint32_t expected_len, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as comsst_data_cas_digest(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_cas_digest(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    const uint8_t expected[COMSST_DIGEST_LEN], uint8_t* buff, uint32_t len);
+
+/**
+ * @brief start a transaction on the session held by the client. The
+ *        writes and deletes staged with comsst_client_txn_write() and
+ *        comsst_client_txn_delete() are not visible until
+ *        comsst_client_txn_commit() applies them, all of them or none
+ *        even across a reboot. At most CONFIG_TA_COMSST_TXN_SIZE bytes
+ *        can be staged. The transaction is lost if the session is.
+ *
+ * @param[in] client the client returned by comsst_client_open()
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_BAD_STATE if a transaction
+ *         is already started, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_client_txn_begin(comsst_client_t* client);
+
+/**
+ * @brief stage a write of the comsst data in the transaction, the data is
+ *        copied
+ *
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_BAD_STATE if no transaction
+ *         is started, TEEC_ERROR_OUT_OF_MEMORY if the transaction is full,
+ *         TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_client_txn_write(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief stage a delete of the comsst data in the transaction, one that
+ *        does not exist at commit time is ignored
+ */
+uint32_t comsst_client_txn_delete(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+/**
+ * @brief apply the staged writes and deletes and end the transaction
+ *
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_BAD_STATE if no transaction
+ *         is started, TEEC_ERROR_* value on failure. The transaction is
+ *         ended whatever the result.
+ */
+uint32_t comsst_client_txn_commit(comsst_client_t* client);
+
+/**
+ * @brief drop the staged writes and deletes and end the transaction
+ */
+uint32_t comsst_client_txn_abort(comsst_client_t* client);
+
+/**
+ * @brief same as comsst_data_read_direct(), but use the session held by
+ *        the client
+ */
+uint32_t comsst_client_data_read_direct(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t* out_len);
+
+/**
+ * @brief same as comsst_data_write_direct(), but use the session held by
+ *        the client
+ */
+uint32_t comsst_client_data_write_direct(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t* buff,
+    uint32_t len);
+
+/**
+ * @brief same as comsst_data_stat(), but use the session held by the client
+ */
+uint32_t comsst_client_data_stat(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t* size, uint32_t* flags);
+
+/**
+ * @brief get the number of bytes the comsst data takes in the secure
+ *        storage, less than its length if the TA compressed it. An item
+ *        the TA packs with others counts its name and index entry too.
+ *
+ * @param[out] stored the number of bytes stored
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_client_data_stored_size(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t* stored);
+
+/**
+ * @brief like comsst_client_data_stored_size(), and tell whether the
+ *        comsst data has an object of its own in the secure storage,
+ *        which costs the per-object overhead of the storage on top
+ *
+ * @param[out] stored  the number of bytes stored
+ * @param[out] objects 1 if the data has an object of its own, 0 if the TA
+ *                     packs it with others
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_client_data_footprint(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t* stored,
+    uint32_t* objects);
+
+/**
+ * @brief same as comsst_data_read_alloc(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_read_alloc(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint8_t** buff,
+    uint32_t* out_len);
+
+/**
+ * @brief same as comsst_list(), but use the session held by the client
+ *        and return one page of CONFIG_CA_COMSST_LIST_PAGE_SIZE bytes of
+ *        names per call
+ *
+ * @param[in,out] cursor 0 to get the first page, then the value returned
+ *                       by the previous call. It is set to 0 once the last
+ *                       page has been returned.
+ */
+uint32_t comsst_client_list(comsst_client_t* client, uint8_t* scope,
+    bool is_deletable, uint32_t* cursor, comsst_list_cb_t cb, void* priv);
+
+/**
+ * @brief same as comsst_scope_clear(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_scope_clear(comsst_client_t* client, uint8_t* scope,
+    bool is_deletable, uint32_t* count);
+
+/**
+ * @brief read len bytes of the comsst data from offset, the data goes
+ *        through a window of CONFIG_CA_COMSST_STREAM_WINDOW bytes
+ *
+ * @param[in,out] len   the number of bytes to read, on output the number
+ *                      of bytes read, less at the end of the comsst data
+ * @param[out]    total the length of the whole comsst data, may be NULL
+ */
+uint32_t comsst_client_data_read_at(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t offset, uint8_t* buff,
+    uint32_t* len, uint32_t* total);
+
+/**
+ * @brief write len bytes of the comsst data at offset, the data goes
+ *        through a window of CONFIG_CA_COMSST_STREAM_WINDOW bytes
+ *
+ * @param[in] create create the comsst data, or empty it if it exists,
+ *                   before writing. Otherwise it must exist already.
+ */
+uint32_t comsst_client_data_write_at(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable, uint32_t offset,
+    uint8_t* buff, uint32_t len, bool create);
+
+/**
+ * @brief same as comsst_data_read_stream(), but use the session held by
+ *        the client
+ */
+uint32_t comsst_client_data_read_stream(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    comsst_stream_sink_t sink, void* priv);
+
+/**
+ * @brief same as comsst_data_write_stream(), but use the session held by
+ *        the client
+ */
+uint32_t comsst_client_data_write_stream(comsst_client_t* client,
+    uint8_t* scope, uint8_t* name, bool is_deletable,
+    comsst_stream_source_t source, void* priv);
+
+/**
+ * @brief same as comsst_data_patch(), but use the session held by the
+ *        client
+ */
+uint32_t comsst_client_data_patch(comsst_client_t* client, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint32_t offset, uint8_t* buff,
+    uint32_t len, bool truncate);
+
+/**
+ * @brief opaque list of comsst operations that are sent to the TA with a
+ *        single invoke, see comsst_batch_run(). The operations are
+ *        numbered from 0 in the order they are added.
+ */
+typedef struct comsst_batch comsst_batch_t;
+
+/**
+ * @brief create an empty batch
+ *
+ * @param[out] batch the new batch, release it with comsst_batch_destroy()
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_batch_create(comsst_batch_t** batch);
+
+/**
+ * @brief free a batch and all the operations in it
+ *
+ * @param[in] batch the batch returned by comsst_batch_create()
+ */
+void comsst_batch_destroy(comsst_batch_t* batch);
+
+/**
+ * @brief add a read to the batch, buff must stay valid until the batch
+ *        has been run. The length that was read is returned by
+ *        comsst_batch_get_result().
+ *
+ * @param[in] batch        the batch to add to
+ * @param[in] scope        the scope the comsst data to fetch
+ * @param[in] name         the name of comsst data to fetch
+ * @param[in] is_deletable deleteable area or non-deletable area
+ * @param[in] buff         the buffer to contain the comsst data
+ * @param[in] len          the size of buff
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_batch_add_read(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief add a write to the batch, the data is copied when the batch is
+ *        run
+ */
+uint32_t comsst_batch_add_write(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief add a delete to the batch
+ */
+uint32_t comsst_batch_add_delete(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+/**
+ * @brief add an existence check to the batch, its result is TEEC_SUCCESS
+ *        if the comsst data exists
+ */
+uint32_t comsst_batch_add_check(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable);
+
+/**
+ * @brief add a verify to the batch
+ */
+uint32_t comsst_batch_add_verify(comsst_batch_t* batch, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len);
+
+/**
+ * @brief run all the operations of the batch in order with one invoke
+ *
+ * @param[in] batch         the batch to run
+ * @param[in] stop_on_error skip the remaining operations once one fails
+ * @return TEEC_SUCCESS if the batch was run, the result of every operation
+ *         is returned by comsst_batch_get_result()
+ */
+uint32_t comsst_batch_run(comsst_batch_t* batch, bool stop_on_error);
+
+/**
+ * @brief same as comsst_batch_run(), but use the session held by the client
+ */
+uint32_t comsst_client_batch_run(comsst_client_t* client,
+    comsst_batch_t* batch, bool stop_on_error);
+
+/**
+ * @brief get the result of one operation of a batch that has been run
+ *
+ * @param[in]  batch   the batch that has been run
+ * @param[in]  index   the number of the operation
+ * @param[out] out_len the length that was read, may be NULL
+ * @return the TEEC_SUCCESS or TEEC_ERROR_* value of the operation,
+ *         TEEC_ERROR_BAD_STATE if it was not run
+ */
+uint32_t comsst_batch_get_result(comsst_batch_t* batch, uint32_t index,
+    uint32_t* out_len);
+
+/**
+ * @brief called once an asynchronous comsst operation has run
+ *
+ * @param[in] res  the TEEC_SUCCESS or TEEC_ERROR_* value of the operation
+ * @param[in] buff the buffer given to a read, NULL for the other operations
+ * @param[in] len  the length that was read, or the length of the comsst
+ *                 data if res is TEEC_ERROR_SHORT_BUFFER
+ * @param[in] arg  the arg given with the operation
+ */
+typedef void (*comsst_async_cb_t)(uint32_t res, uint8_t* buff, uint32_t len,
+    void* arg);
+
+/**
+ * @brief opaque queue of asynchronous comsst operations. A worker thread
+ *        runs them in order with a session of its own, everything queued
+ *        meanwhile is sent with a single invoke. At most
+ *        CONFIG_CA_COMSST_ASYNC_QUEUE_SIZE operations wait to be run.
+ *        The operations bypass the comsst cache of the process, except
+ *        that their writes and deletes drop what it holds.
+ */
+typedef struct comsst_async comsst_async_t;
+
+/**
+ * @brief open a queue of asynchronous comsst operations
+ *
+ * @param[out] async    the queue, release it with comsst_async_close()
+ * @param[in]  pollable if false, the callbacks are called by the worker
+ *                      thread. If true, the fd returned by
+ *                      comsst_async_get_fd() gets readable once operations
+ *                      have run, and comsst_async_dispatch() calls their
+ *                      callbacks in the calling thread.
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t comsst_async_open(comsst_async_t** async, bool pollable);
+
+/**
+ * @brief run what is queued, call the callbacks not dispatched yet and
+ *        release the queue
+ */
+void comsst_async_close(comsst_async_t* async);
+
+/**
+ * @brief get the fd to poll for POLLIN of a pollable queue, -1 otherwise
+ */
+int comsst_async_get_fd(comsst_async_t* async);
+
+/**
+ * @brief call the callbacks of the operations of a pollable queue that
+ *        have run
+ */
+void comsst_async_dispatch(comsst_async_t* async);
+
+/**
+ * @brief wait until every operation queued so far has run
+ */
+void comsst_async_flush(comsst_async_t* async);
+
+/**
+ * @brief queue a read of the comsst data, buff must stay valid until the
+ *        callback is called
+ *
+ * @return TEEC_SUCCESS if it was queued, TEEC_ERROR_BUSY if the queue is
+ *         full, TEEC_ERROR_* value on failure. The callback is only
+ *         called for a queued operation.
+ */
+uint32_t comsst_async_read(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len,
+    comsst_async_cb_t cb, void* arg);
+
+/**
+ * @brief queue a write of the comsst data, the data is copied
+ */
+uint32_t comsst_async_write(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, uint8_t* buff, uint32_t len,
+    comsst_async_cb_t cb, void* arg);
+
+/**
+ * @brief queue a delete of the comsst data
+ */
+uint32_t comsst_async_delete(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, comsst_async_cb_t cb, void* arg);
+
+/**
+ * @brief queue an existence check of the comsst data, its result is
+ *        TEEC_SUCCESS if the comsst data exists
+ */
+uint32_t comsst_async_check(comsst_async_t* async, uint8_t* scope,
+    uint8_t* name, bool is_deletable, comsst_async_cb_t cb, void* arg);
+
+/**
+ * @brief same as comsst_async_read(), on a queue of the process that is
+ *        opened on first use and calls the callbacks from its worker
+ *        thread
+ */
+uint32_t comsst_data_read_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, comsst_async_cb_t cb,
+    void* arg);
+
+/**
+ * @brief same as comsst_async_write(), on the queue of the process
+ */
+uint32_t comsst_data_write_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, uint8_t* buff, uint32_t len, comsst_async_cb_t cb,
+    void* arg);
+
+/**
+ * @brief same as comsst_async_delete(), on the queue of the process
+ */
+uint32_t comsst_data_delete_async(uint8_t* scope, uint8_t* name,
+    bool is_deletable, comsst_async_cb_t cb, void* arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,8 @@
 #ifndef TA_COMSST_H
 #define TA_COMSST_H
 
+#include <stdint.h>
+
 /*
  * This UUID is generated with uuidgen
  * the ITU-T UUID generator at http://www.itu.int/ITU-T/asn1/uuid.html
@@ -36,5 +38,129 @@
 #define TA_COMSST_CMD_WR 2
 #define TA_COMSST_CMD_RD 3
 #define TA_COMSST_CMD_VR 4
+#define TA_COMSST_CMD_STAT 5
+#define TA_COMSST_CMD_BATCH 6
+#define TA_COMSST_CMD_LIST 7
+#define TA_COMSST_CMD_DEL_SCOPE 8
+#define TA_COMSST_CMD_RD_CHUNK 9
+#define TA_COMSST_CMD_WR_CHUNK 10
+#define TA_COMSST_CMD_PATCH 11
+#define TA_COMSST_CMD_DIGEST 12
+#define TA_COMSST_CMD_CAS 13
+#define TA_COMSST_CMD_TXN_BEGIN 14
+#define TA_COMSST_CMD_TXN_STAGE 15
+#define TA_COMSST_CMD_TXN_COMMIT 16
+#define TA_COMSST_CMD_TXN_ABORT 17
+
+/*
+ * The item commands take the length of the name in value.a of their first
+ * param and COMSST_ITEM_FLAGS() in value.b, a batch operation takes the
+ * latter in is_deletable. The name is "scope + name", scope_len tells
+ * where the scope ends. A client not passing it gets an empty scope.
+ */
+
+#define COMSST_ITEM_DELETABLE (1 << 0)
+#define COMSST_ITEM_DIGEST (1 << 1) /* the data to compare is a digest */
+#define COMSST_ITEM_ABSENT (1 << 2) /* TA_COMSST_CMD_CAS: expect no item */
+#define COMSST_ITEM_REMOVE (1 << 3) /* TA_COMSST_CMD_TXN_STAGE: delete */
+#define COMSST_ITEM_COMPRESS (1 << 4) /* write compressed at any size */
+#define COMSST_ITEM_SCOPE_SHIFT 8
+#define COMSST_ITEM_FLAGS(is_deletable, scope_len)  \
+    (((is_deletable) ? COMSST_ITEM_DELETABLE : 0) \
+        | ((uint32_t)(scope_len) << COMSST_ITEM_SCOPE_SHIFT))
+#define COMSST_ITEM_SCOPE_LEN(flags) ((flags) >> COMSST_ITEM_SCOPE_SHIFT)
+
+/*
+ * The longest "scope + name", so that a listed name fits its length byte.
+ * Unless the TA hashes the object IDs, it is bounded by the length of an
+ * object ID as well.
+ */
+
+#define COMSST_NAME_MAX 255
+
+/*
+ * TA_COMSST_CMD_BATCH takes a VALUE_INOUT and a MEMREF_INOUT. value.a is
+ * the number of operations on input and the number of operations that
+ * were run on output, value.b holds the COMSST_BATCH_* flags. The memref
+ * holds the operations one after another, each one is a struct
+ * comsst_batch_op followed by the name and a data area of data_len bytes,
+ * padded to COMSST_BATCH_ALIGN. The TA fills in status and out_len, and
+ * the data area for a read.
+ */
+
+#define COMSST_BATCH_STOP_ON_ERROR (1 << 0)
+#define COMSST_BATCH_ALIGN(x) (((x) + 3) & ~3)
+
+struct comsst_batch_op {
+    uint32_t cmd;
+    uint32_t is_deletable;
+    uint32_t name_len;
+    uint32_t data_len;
+    uint32_t status;
+    uint32_t out_len;
+};
+
+/*
+ * TA_COMSST_CMD_LIST takes a VALUE_INPUT (a: prefix length,
+ * b: is_deletable), a MEMREF_INPUT prefix, a MEMREF_OUTPUT page and a
+ * VALUE_INOUT (a: cursor, b: number of names returned). The page is
+ * filled with records of one length byte followed by the object ID with
+ * the prefix removed. Pass cursor 0 for the first page and the returned
+ * cursor, which is opaque, for the next ones, 0 is returned once there are
+ * no more IDs. TEE_ERROR_OVERFLOW is returned when a page ends past the
+ * 65535th object of the storage, where no cursor can point.
+ */
+
+/*
+ * TA_COMSST_CMD_RD_CHUNK and TA_COMSST_CMD_WR_CHUNK use the split layout
+ * followed by a VALUE_INOUT. value.a is the offset in the item to read or
+ * write the data memref at. On input value.b holds the COMSST_CHUNK_*
+ * flags, on output it is the length of the whole item. A read returns the
+ * number of bytes read as the size of the data memref.
+ */
+
+#define COMSST_CHUNK_CREATE (1 << 0) /* create or truncate the item first */
+
+/*
+ * TA_COMSST_CMD_PATCH uses the same params as TA_COMSST_CMD_WR_CHUNK, but
+ * value.b is the length to set the item to after the data is written, or
+ * COMSST_PATCH_KEEP_SIZE. The item must exist, only the bytes written and
+ * the ones added or removed at its end change.
+ */
+
+#define COMSST_PATCH_KEEP_SIZE 0xffffffff
+
+/*
+ * TA_COMSST_CMD_STAT takes an optional VALUE_OUTPUT last, value.a gets
+ * the number of bytes the item takes in the storage, which is less than
+ * its length if it is compressed, and value.b the number of objects of
+ * its own, 1, or 0 for an item packed in the container of its scope. The
+ * bytes of a packed item are its record and index entry in the container.
+ */
+
+/*
+ * TA_COMSST_CMD_DIGEST uses the split layout with a MEMREF_OUTPUT of at
+ * least 32 bytes, which gets the SHA-256 digest of the data of the item.
+ * With COMSST_ITEM_DIGEST, TA_COMSST_CMD_VR takes such a digest in place
+ * of the data to verify.
+ */
+
+/*
+ * TA_COMSST_CMD_CAS uses the split layout for the new data of the item
+ * followed by a MEMREF_INPUT with the data the item is expected to hold,
+ * or its digest with COMSST_ITEM_DIGEST. With COMSST_ITEM_ABSENT the item
+ * is expected not to exist and the memref is ignored. The item is written
+ * only if it is as expected, TEE_ERROR_ACCESS_CONFLICT is returned
+ * otherwise.
+ */
+
+/*
+ * TA_COMSST_CMD_TXN_BEGIN starts a transaction in the session, all with
+ * no params. TA_COMSST_CMD_TXN_STAGE uses the split layout of
+ * TA_COMSST_CMD_WR to stage a write of the item, or its delete with
+ * COMSST_ITEM_REMOVE. TA_COMSST_CMD_TXN_COMMIT applies the staged items
+ * all or none of them, TA_COMSST_CMD_TXN_ABORT drops them, and both end
+ * the transaction. Without one, TEE_ERROR_BAD_STATE is returned.
+ */
 
 #endif /*TA_COMSST_H*/
\ No newline at end of file
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <tee_shm_pool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -94,6 +95,71 @@ uint32_t pin_change(bool is_deletable, uint8_t* old, uint32_t oldlen,
  */
 uint32_t pin_getsha256(bool is_deletable, uint8_t* buff, uint32_t len);
 
+/**
+ * @brief opaque handle to the pin TA, it holds one TEE context and one
+ *        session, so that several pin operations in a row only pay the
+ *        context and session setup once. A handle must not be used by
+ *        more than one thread at the same time.
+ */
+typedef struct pin_handle pin_handle_t;
+
+/**
+ * @brief open a handle to the pin TA
+ *
+ * @param[out] handle the opened handle, release it with pin_close()
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+uint32_t pin_open(pin_handle_t** handle);
+
+/**
+ * @brief close the session and context held by the handle and free it
+ *
+ * @param[in] handle the handle returned by pin_open()
+ */
+void pin_close(pin_handle_t* handle);
+
+/**
+ * @brief same as pin_store(), but use the session held by the handle
+ */
+uint32_t pin_handle_store(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as pin_is_exist(), but use the session held by the handle
+ */
+bool pin_handle_is_exist(pin_handle_t* handle, bool is_deletable);
+
+/**
+ * @brief same as pin_delete(), but use the session held by the handle
+ */
+uint32_t pin_handle_delete(pin_handle_t* handle, bool is_deletable);
+
+/**
+ * @brief same as pin_verify(), but use the session held by the handle
+ */
+uint32_t pin_handle_verify(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len);
+
+/**
+ * @brief same as pin_change(), but use the session held by the handle
+ */
+uint32_t pin_handle_change(pin_handle_t* handle, bool is_deletable,
+    uint8_t* old, uint32_t oldlen, uint8_t* new, uint32_t newlen);
+
+/**
+ * @brief same as pin_getsha256(), but use the session held by the handle
+ */
+uint32_t pin_handle_getsha256(pin_handle_t* handle, bool is_deletable,
+    uint8_t* buff, uint32_t len);
+
+/**
+ * @brief get the usage of the shared memory pool of the handle
+ *
+ * @param[in]  handle the handle returned by pin_open()
+ * @param[out] stats  the usage of the shared memory pool
+ */
+void pin_get_shm_stats(pin_handle_t* handle, struct tee_shm_pool_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
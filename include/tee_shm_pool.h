@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2022-2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TEE_SHM_POOL_H_
+#define _TEE_SHM_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <tee_client_api.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Slabs of 32, 64, 128, 256 and 512 bytes are carved out of the region */
+
+#define TEE_SHM_POOL_CLASSES 5
+#define TEE_SHM_POOL_MIN_CLASS 32
+#define TEE_SHM_POOL_MAX_SLOTS 64
+
+/**
+ * @brief usage of a shared memory pool, all sizes are in bytes
+ */
+struct tee_shm_pool_stats {
+    size_t size; /* size of the region reserved up front */
+    size_t cur; /* bytes of the region handed out right now */
+    size_t peak; /* highest value cur has reached */
+    uint32_t allocs; /* number of allocations served by the region */
+    uint32_t fallbacks; /* number of allocations that did not fit */
+    size_t fallback_peak; /* largest allocation that did not fit */
+};
+
+/**
+ * @brief a piece of shared memory handed out by the pool. Pass it to the
+ *        TA as a TEEC_MEMREF_PARTIAL_* parameter, see tee_shm_pool_memref()
+ */
+struct tee_shm_slab {
+    TEEC_SharedMemory* shm;
+    size_t offset;
+    size_t size;
+    void* buffer;
+    int cls;
+    int slot;
+};
+
+/**
+ * @brief per TEE context shared memory pool. One region is allocated with
+ *        TEEC_AllocateSharedMemory() on first use and split into size
+ *        class slabs. Allocations that no free slab can hold get a
+ *        dedicated block, the largest of those is kept for the next
+ *        oversized allocation. A pool must not be used by more than one
+ *        thread at the same time.
+ */
+struct tee_shm_pool {
+    TEEC_Context* ctx;
+    TEEC_SharedMemory region;
+    bool region_allocated;
+    size_t base[TEE_SHM_POOL_CLASSES];
+    int nslots[TEE_SHM_POOL_CLASSES];
+    uint64_t busy[TEE_SHM_POOL_CLASSES];
+    TEEC_SharedMemory* spare;
+    struct tee_shm_pool_stats stats;
+};
+
+/**
+ * @brief initialize a pool on top of an initialized TEE context, nothing
+ *        is allocated until the first tee_shm_pool_alloc()
+ *
+ * @param[in] pool the pool to initialize
+ * @param[in] ctx  the TEE context the shared memory belongs to
+ */
+void tee_shm_pool_init(struct tee_shm_pool* pool, TEEC_Context* ctx);
+
+/**
+ * @brief release all the shared memory held by the pool, every slab must
+ *        have been freed before
+ *
+ * @param[in] pool the pool to release
+ */
+void tee_shm_pool_deinit(struct tee_shm_pool* pool);
+
+/**
+ * @brief allocate a slab of at least size bytes that the TA can read and
+ *        write
+ *
+ * @param[in]  pool the pool to allocate from
+ * @param[in]  size the number of bytes needed
+ * @param[out] slab the allocated slab
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+TEEC_Result tee_shm_pool_alloc(struct tee_shm_pool* pool, size_t size,
+    struct tee_shm_slab* slab);
+
+/**
+ * @brief give a slab back to the pool
+ *
+ * @param[in] pool the pool the slab was allocated from
+ * @param[in] slab the slab to free
+ */
+void tee_shm_pool_free(struct tee_shm_pool* pool, struct tee_shm_slab* slab);
+
+/**
+ * @brief point a TEEC_MEMREF_PARTIAL_* parameter at the first size bytes
+ *        of a slab
+ *
+ * @param[in]  slab  the slab to pass to the TA
+ * @param[in]  size  the number of bytes to pass, at most slab->size
+ * @param[out] param the operation parameter to fill
+ */
+void tee_shm_pool_memref(const struct tee_shm_slab* slab, size_t size,
+    TEEC_Parameter* param);
+
+/**
+ * @brief get the usage of a pool, to help sizing CONFIG_CA_SHM_POOL_SIZE
+ *
+ * @param[in]  pool  the pool to query
+ * @param[out] stats the usage of the pool
+ */
+void tee_shm_pool_get_stats(struct tee_shm_pool* pool,
+    struct tee_shm_pool_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -74,6 +74,64 @@ int triad_load_key(uint8_t* key, uint16_t len);
 int triad_get_hmac(uint8_t* input, uint16_t inlen,
     uint8_t* output, uint16_t outlen);
 
+/**
+ * @brief calculate the hmac of several messages in one invocation, the key
+ *        of the hmac is the key that we stored with triad_store_key()
+ *        previously
+ *
+ * @param[in]  inputs the messages that need to calculate the hmac
+ * @param[in]  inlens the length of each message
+ * @param[in]  count  the number of messages
+ * @param[out] output the buffer using to store the hmacs, the hmac of
+ *                    inputs[i] is stored at output + 32 * i
+ * @param[in]  outlen the length of the output buffer, at least 32 * count
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+int triad_get_hmac_batch(const uint8_t* const* inputs,
+    const uint32_t* inlens, uint32_t count, uint8_t* output,
+    uint32_t outlen);
+
+/**
+ * @brief context of a multi-part hmac, it keeps a session to the triad TA
+ *        and one fixed size shared memory buffer that all the data is
+ *        streamed through, see CONFIG_CA_TRIAD_HMAC_CHUNK_SIZE
+ */
+typedef struct triad_hmac_ctx triad_hmac_ctx_t;
+
+/**
+ * @brief start a multi-part hmac keyed with the key that we stored with
+ *        triad_store_key() previously
+ *
+ * @param[out] hctx the context of the hmac, it is released by
+ *                  triad_hmac_final()
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+int triad_hmac_init(triad_hmac_ctx_t** hctx);
+
+/**
+ * @brief feed the next part of the data to the hmac, the part can be of
+ *        any length, it is split to fit the shared memory buffer
+ *
+ * @param[in] hctx  the context returned by triad_hmac_init()
+ * @param[in] input the next part of the data
+ * @param[in] inlen the length of the part
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+int triad_hmac_update(triad_hmac_ctx_t* hctx, const uint8_t* input,
+    uint32_t inlen);
+
+/**
+ * @brief finish the hmac and release the context, the context is released
+ *        whether the hmac succeeds or not
+ *
+ * @param[in]  hctx   the context returned by triad_hmac_init()
+ * @param[out] output the buffer using to store the hmac content that calculated
+ * @param[in]  outlen the length of the result hmac, the length is fixed at 32
+ * @return TEEC_SUCCESS on success, TEEC_ERROR_* value on failure
+ */
+int triad_hmac_final(triad_hmac_ctx_t* hctx, uint8_t* output,
+    uint16_t outlen);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,5 +36,9 @@
 #define TA_TRIAD_CMD_STORE_KEY 2
 #define TA_TRIAD_CMD_LOAD_KEY 3
 #define TA_TRIAD_CMD_GET_HMAC 4
+#define TA_TRIAD_CMD_HMAC_INIT 5
+#define TA_TRIAD_CMD_HMAC_UPDATE 6
+#define TA_TRIAD_CMD_HMAC_FINAL 7
+#define TA_TRIAD_CMD_GET_HMAC_BATCH 8
 
 #endif
\ No newline at end of file
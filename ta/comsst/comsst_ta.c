@@ -16,10 +16,95 @@
 
 #include <comsst_ta.h>
 #include <kernel/user_ta.h>
+#include <nuttx/config.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <tee_internal_api.h>
 #include <trace.h>
 
+/*
+ * All the sessions share one instance of the TA, which serializes their
+ * commands: a compare-and-swap, the read-modify-write of a container and
+ * the journal of a transaction are only atomic against each other within
+ * one instance. The cache and the existence filter are only worth it if
+ * that instance also outlives the sessions.
+ */
+
+#if CONFIG_TA_COMSST_CACHE_SIZE > 0 || CONFIG_TA_COMSST_FILTER_BITS > 0
+#define COMSST_TA_KEEP_ALIVE TA_FLAG_INSTANCE_KEEP_ALIVE
+#else
+#define COMSST_TA_KEEP_ALIVE 0
+#endif
+
+#define COMSST_TA_FLAGS (TA_FLAG_USER_MODE | TA_FLAG_SINGLE_INSTANCE \
+    | TA_FLAG_MULTI_SESSION | COMSST_TA_KEEP_ALIVE)
+
+/* Items of at most COMSST_PACKED_ITEM_MAX bytes are packed per scope */
+
+#ifdef CONFIG_TA_COMSST_LAYOUT_PACKED
+#define COMSST_PACKED 1
+#define COMSST_PACKED_ITEM_MAX CONFIG_TA_COMSST_PACKED_ITEM_MAX
+#else
+#define COMSST_PACKED 0
+#define COMSST_PACKED_ITEM_MAX 0
+#endif
+
+/* The ID of the container of a scope, see Comsst_PackId() */
+
+#define COMSST_PACK_SUFFIX "\0P"
+#define COMSST_PACK_SUFFIX_LEN 2
+
+/* A NUL and the length of the scope end the ID, see Comsst_SplitId() */
+
+#define COMSST_SPLIT_SUFFIX_LEN 2
+
+/* The object IDs are digests of the names, see Comsst_ObjectId() */
+
+#ifdef CONFIG_TA_COMSST_LAYOUT_HASHED
+#define COMSST_HASHED 1
+#else
+#define COMSST_HASHED 0
+#endif
+
+/* Items are looked up in an existence filter first, see Comsst_FilterMiss() */
+
+#if CONFIG_TA_COMSST_FILTER_BITS > 0
+#define COMSST_FILTER 1
+#define COMSST_FILTER_BITS CONFIG_TA_COMSST_FILTER_BITS
+#else
+#define COMSST_FILTER 0
+#define COMSST_FILTER_BITS 1
+#endif
+
+/* Items are compressed before they are stored, see Comsst_ZPack() */
+
+#ifdef CONFIG_TA_COMSST_COMPRESS
+#define COMSST_COMPRESS 1
+#else
+#define COMSST_COMPRESS 0
+#endif
+
+#if COMSST_COMPRESS && CONFIG_TA_COMSST_COMPRESS_MIN > 0
+#define COMSST_COMPRESS_MIN CONFIG_TA_COMSST_COMPRESS_MIN
+#else
+#define COMSST_COMPRESS_MIN SIZE_MAX /* only on request */
+#endif
+
+/* Length of a SHA-256 digest, of an object ID or of the data of an item */
+
+#define COMSST_DIGEST_LEN 32
+
+/* Number of bytes hashed at a time by Comsst_DigestObject() */
+
+#define COMSST_DIGEST_CHUNK 256
+
+/* The param types of the first three params, the last one set to NONE */
+
+#define COMSST_PARAM_TYPES_HEAD(t)                                \
+    TEE_PARAM_TYPES(TEE_PARAM_TYPE_GET(t, 0), TEE_PARAM_TYPE_GET(t, 1), \
+        TEE_PARAM_TYPE_GET(t, 2), TEE_PARAM_TYPE_NONE)
+
 static TEE_Result Comsst_CheckItem(uint32_t param_types __unused,
     TEE_Param params[4] __unused);
 static TEE_Result Comsst_DeleteItem(uint32_t param_types __unused,
@@ -30,6 +115,48 @@ static TEE_Result Comsst_WriteItem(uint32_t param_types __unused,
     TEE_Param params[4] __unused);
 static TEE_Result Comsst_VerifyItem(uint32_t param_types __unused,
     TEE_Param params[4] __unused);
+static TEE_Result Comsst_StatItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_RunBatch(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_ListItems(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_DeleteScope(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_ReadChunk(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_WriteChunk(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_PatchItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_GetDigest(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_CasItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused);
+static TEE_Result Comsst_Txn(void* sess_ctx, uint32_t cmd_id,
+    uint32_t param_types, TEE_Param params[4]);
+static TEE_Result Comsst_JournalRecover(void);
+static void Comsst_CacheFlush(void);
+static void Comsst_DigestFree(void);
+static void Comsst_FilterFree(void);
+
+/*
+ * A committed transaction whose journal is not applied yet, it is applied
+ * before the next command, see Comsst_JournalRecover()
+ */
+
+static bool g_comsst_journal_left;
+
+/*
+ * The state of a session, the items staged by its transaction. txn holds
+ * struct comsst_txn_rec records back to back, see Comsst_TxnStage().
+ */
+
+struct comsst_session {
+    bool in_txn;
+    uint8_t* txn;
+    size_t txn_len;
+};
 
 /*
  * Called when the instance of the TA is created. This is the first call in
@@ -37,8 +164,21 @@ static TEE_Result Comsst_VerifyItem(uint32_t param_types __unused,
  */
 TEE_Result COMSST_TA_CreateEntryPoint(void)
 {
+    TEE_Result res;
+
     DMSG("has been called\n");
 
+    /*
+     * Finish the transaction a previous instance committed, if any. This
+     * instance is the only one, see COMSST_TA_FLAGS, so no other applies
+     * the journal meanwhile. If it fails the next command tries again.
+     */
+
+    res = Comsst_JournalRecover();
+    if (res != TEE_SUCCESS) {
+        EMSG("d5e80b37:0x%08" PRIx32 "\n", res);
+    }
+
     return TEE_SUCCESS;
 }
 
@@ -49,6 +189,9 @@ TEE_Result COMSST_TA_CreateEntryPoint(void)
 void COMSST_TA_DestroyEntryPoint(void)
 {
     DMSG("has been called\n");
+    Comsst_CacheFlush();
+    Comsst_DigestFree();
+    Comsst_FilterFree();
 }
 
 /*
@@ -59,7 +202,7 @@ void COMSST_TA_DestroyEntryPoint(void)
  */
 TEE_Result COMSST_TA_OpenSessionEntryPoint(uint32_t param_types,
     TEE_Param __maybe_unused params[4],
-    void __maybe_unused** sess_ctx)
+    void** sess_ctx)
 {
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
         TEE_PARAM_TYPE_NONE,
@@ -77,6 +220,12 @@ TEE_Result COMSST_TA_OpenSessionEntryPoint(uint32_t param_types,
      */
     DMSG("COMSST TA!\n");
 
+    *sess_ctx = TEE_Malloc(sizeof(struct comsst_session),
+        TEE_MALLOC_FILL_ZERO);
+    if (*sess_ctx == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
     /* If return value != TEE_SUCCESS the session will not be created. */
     return TEE_SUCCESS;
 }
@@ -85,9 +234,14 @@ TEE_Result COMSST_TA_OpenSessionEntryPoint(uint32_t param_types,
  * Called when a session is closed, sess_ctx hold the value that was
  * assigned by TA_OpenSessionEntryPoint().
  */
-void COMSST_TA_CloseSessionEntryPoint(void __maybe_unused* sess_ctx)
+void COMSST_TA_CloseSessionEntryPoint(void* sess_ctx)
 {
-    (void)&sess_ctx; /* Unused parameter */
+    struct comsst_session* session = sess_ctx;
+
+    /* A transaction that was not committed is dropped */
+
+    TEE_Free(session->txn);
+    TEE_Free(session);
     DMSG("Goodbye!\n");
 }
 
@@ -96,13 +250,9 @@ void COMSST_TA_CloseSessionEntryPoint(void __maybe_unused* sess_ctx)
  * assigned by TA_OpenSessionEntryPoint(). The rest of the paramters
  * comes from normal world.
  */
-TEE_Result COMSST_TA_InvokeCommandEntryPoint(void __maybe_unused* sess_ctx,
-    uint32_t cmd_id,
-    uint32_t param_types, TEE_Param params[4])
+static TEE_Result Comsst_Dispatch(uint32_t cmd_id, uint32_t param_types,
+    TEE_Param params[4])
 {
-    (void)&sess_ctx; /* Unused parameter */
-
-    DMSG("cmd: 0x%08" PRIx32 "\n", cmd_id);
     switch (cmd_id) {
     case TA_COMSST_CMD_CHK:
         return Comsst_CheckItem(param_types, params);
@@ -114,271 +264,3707 @@ TEE_Result COMSST_TA_InvokeCommandEntryPoint(void __maybe_unused* sess_ctx,
         return Comsst_ReadItem(param_types, params);
     case TA_COMSST_CMD_VR:
         return Comsst_VerifyItem(param_types, params);
+    case TA_COMSST_CMD_STAT:
+        return Comsst_StatItem(param_types, params);
+    case TA_COMSST_CMD_LIST:
+        return Comsst_ListItems(param_types, params);
+    case TA_COMSST_CMD_DEL_SCOPE:
+        return Comsst_DeleteScope(param_types, params);
+    case TA_COMSST_CMD_RD_CHUNK:
+        return Comsst_ReadChunk(param_types, params);
+    case TA_COMSST_CMD_WR_CHUNK:
+        return Comsst_WriteChunk(param_types, params);
+    case TA_COMSST_CMD_PATCH:
+        return Comsst_PatchItem(param_types, params);
+    case TA_COMSST_CMD_DIGEST:
+        return Comsst_GetDigest(param_types, params);
+    case TA_COMSST_CMD_CAS:
+        return Comsst_CasItem(param_types, params);
     default:
         EMSG("ee962c07:0x%08" PRIx32 "\n", cmd_id);
         return TEE_ERROR_BAD_PARAMETERS;
     }
 }
 
-static TEE_Result Comsst_CheckItem(uint32_t param_types __unused,
-    TEE_Param params[4] __unused)
+TEE_Result COMSST_TA_InvokeCommandEntryPoint(void* sess_ctx,
+    uint32_t cmd_id,
+    uint32_t param_types, TEE_Param params[4])
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
-        TEE_PARAM_TYPE_MEMREF_INPUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+    DMSG("cmd: 0x%08" PRIx32 "\n", cmd_id);
 
-    if (param_types != exp_param_types) {
-        EMSG("718fc92c\n");
-        return TEE_ERROR_BAD_PARAMETERS;
+    /* No command sees the items of a transaction only half applied */
+
+    if (g_comsst_journal_left) {
+        Comsst_JournalRecover();
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
+    /* A transaction belongs to the session, it can not be batched either */
 
-    if (params[0].value.b == 0) {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
-    } else {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_USER,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
+    if (cmd_id >= TA_COMSST_CMD_TXN_BEGIN
+        && cmd_id <= TA_COMSST_CMD_TXN_ABORT) {
+        return Comsst_Txn(sess_ctx, cmd_id, param_types, params);
     }
 
-    if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
-        goto exit;
-    }
+    /* A batch runs its operations through Comsst_Dispatch(), never nested */
 
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
+    if (cmd_id == TA_COMSST_CMD_BATCH) {
+        return Comsst_RunBatch(param_types, params);
+    }
 
-exit:
-    return res;
+    return Comsst_Dispatch(cmd_id, param_types, params);
 }
 
-static TEE_Result Comsst_DeleteItem(uint32_t param_types __unused,
-    TEE_Param params[4] __unused)
+/*
+ * An item is addressed by one of two param layouts:
+ *
+ * packed: VALUE (a: name length, b: COMSST_ITEM_FLAGS), MEMREF "name + data"
+ * split:  VALUE (a: name length, b: COMSST_ITEM_FLAGS), MEMREF name,
+ *         MEMREF data
+ *
+ * Commands that return no data (e.g. stat) use the split layout with a
+ * VALUE_OUTPUT in place of the data memref.
+ *
+ * The split layout lets the client pass its own buffer for the data, so it
+ * does not have to be copied next to the name first.
+ *
+ * The name is copied out of shared memory to fullname, the client must
+ * not be able to change it between the storage access and the cache
+ * update. name is the ID of the object of the item, fullname itself unless
+ * the IDs are hashed.
+ */
+
+struct comsst_item {
+    uint32_t storage;
+    void* name;
+    size_t name_len;
+    size_t scope_len;
+    uint32_t flags;
+    void* data;
+    size_t data_len;
+    bool split;
+    uint8_t fullname[COMSST_NAME_MAX];
+    size_t fullname_len;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+};
+
+/* The SHA-256 operation of the object IDs and of the item digests */
+
+static TEE_OperationHandle g_comsst_digest = TEE_HANDLE_NULL;
+
+static TEE_Result Comsst_DigestOp(TEE_OperationHandle* op)
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
-        TEE_PARAM_TYPE_MEMREF_INPUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+    TEE_Result res;
 
-    if (param_types != exp_param_types) {
-        EMSG("718fc92c\n");
-        return TEE_ERROR_BAD_PARAMETERS;
+    if (g_comsst_digest == TEE_HANDLE_NULL) {
+        res = TEE_AllocateOperation(&g_comsst_digest, TEE_ALG_SHA256,
+            TEE_MODE_DIGEST, 0);
+        if (res != TEE_SUCCESS) {
+            EMSG("a4c1e87b:0x%08" PRIx32 "\n", res);
+            g_comsst_digest = TEE_HANDLE_NULL;
+            return res;
+        }
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
+    /* Drop what a digest given up half way may have left */
 
-    if (params[0].value.b == 0) {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_WRITE_META,
-            &obj);
-    } else {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_USER,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_WRITE_META,
-            &obj);
-    }
+    TEE_ResetOperation(g_comsst_digest);
+    *op = g_comsst_digest;
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_Digest(const void* data, size_t len,
+    uint8_t* digest)
+{
+    TEE_OperationHandle op;
+    TEE_Result res;
+    size_t digest_len = COMSST_DIGEST_LEN;
 
+    res = Comsst_DigestOp(&op);
     if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
         return res;
     }
 
-    DMSG("TEE_CloseAndDeletePersistentObject1()...\n");
-    res = TEE_CloseAndDeletePersistentObject1(obj);
+    res = TEE_DigestDoFinal(op, data, len, digest, &digest_len);
     if (res != TEE_SUCCESS) {
-        EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
-        return res;
+        EMSG("f6d3092e:0x%08" PRIx32 "\n", res);
     }
-    return TEE_SUCCESS;
+
+    return res;
 }
 
-static TEE_Result Comsst_ReadItem(uint32_t param_types __unused,
-    TEE_Param params[4] __unused)
+static void Comsst_DigestFree(void)
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    size_t read_len;
-    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
-        TEE_PARAM_TYPE_MEMREF_INOUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+    if (g_comsst_digest != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(g_comsst_digest);
+        g_comsst_digest = TEE_HANDLE_NULL;
+    }
+}
 
-    if (param_types != exp_param_types) {
-        EMSG("718fc92c\n");
-        return TEE_ERROR_BAD_PARAMETERS;
+/*
+ * With the packed layout, ("ab", "c") and ("a", "bc") are two items, in
+ * the containers of "ab" and of "a". So that they remain two once they
+ * grow out of their containers, the ID of an object of its own is the
+ * "scope + name" followed by a NUL and the length of the scope. No name
+ * holds a NUL and a scope is shorter than the 'P' of COMSST_PACK_SUFFIX,
+ * so this ID is never the one of a container.
+ */
+
+static void Comsst_SplitId(const uint8_t* fullname, size_t fullname_len,
+    size_t scope_len, uint8_t* id, size_t* id_len)
+{
+    memcpy(id, fullname, fullname_len);
+    id[fullname_len] = '\0';
+    id[fullname_len + 1] = scope_len;
+    *id_len = fullname_len + COMSST_SPLIT_SUFFIX_LEN;
+}
+
+/*
+ * With hashed IDs, the ID of the object of an item is the SHA-256 digest
+ * of its "scope + name", which may then be longer than an object ID. The
+ * name itself is kept as the value of the object, see
+ * Comsst_CreateObject(), so that the items can still be enumerated.
+ */
+
+static TEE_Result Comsst_ObjectId(struct comsst_item* item)
+{
+    TEE_Result res;
+
+    if (COMSST_PACKED) {
+        if (item->fullname_len + COMSST_SPLIT_SUFFIX_LEN
+            > TEE_OBJECT_ID_MAX_LEN) {
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        Comsst_SplitId(item->fullname, item->fullname_len, item->scope_len,
+            item->id, &item->name_len);
+        item->name = item->id;
+        return TEE_SUCCESS;
+    } else if (!COMSST_HASHED) {
+        if (item->fullname_len > TEE_OBJECT_ID_MAX_LEN) {
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        item->name = item->fullname;
+        item->name_len = item->fullname_len;
+        return TEE_SUCCESS;
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
+    /* The value of an object can not be empty */
 
-    if (params[0].value.b == 0) {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
-    } else {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_USER,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
+    if (item->fullname_len == 0) {
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
+    res = Comsst_Digest(item->fullname, item->fullname_len, item->id);
     if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
         return res;
     }
 
-    DMSG("TEE_ReadObjectData()...\n");
+    item->name = item->id;
+    item->name_len = COMSST_DIGEST_LEN;
+    return TEE_SUCCESS;
+}
 
-    res = TEE_ReadObjectData(obj, params[1].memref.buffer,
-        params[1].memref.size, &read_len);
-    if (res != TEE_SUCCESS) {
-        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
-            res, read_len);
-        goto exit;
+static void Comsst_FilterAdd(const struct comsst_item* item);
+static bool Comsst_PackIsId(const uint8_t* id, size_t id_len);
+
+/* Create, or replace, the object of an item with data_len bytes of data */
+
+static TEE_Result Comsst_CreateObject(const struct comsst_item* item,
+    const void* data, size_t data_len, TEE_ObjectHandle* obj)
+{
+    TEE_ObjectHandle attrs = TEE_HANDLE_NULL;
+    TEE_Attribute attr;
+    TEE_Result res;
+
+    if (COMSST_HASHED) {
+        res = TEE_AllocateTransientObject(TEE_TYPE_GENERIC_SECRET,
+            item->fullname_len * 8, &attrs);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+
+        TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, item->fullname,
+            item->fullname_len);
+        res = TEE_PopulateTransientObject(attrs, &attr, 1);
+        if (res != TEE_SUCCESS) {
+            goto exit;
+        }
     }
 
-    params[0].value.b = read_len;
+    res = TEE_CreatePersistentObject(item->storage, item->name,
+        item->name_len,
+        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, attrs,
+        data, data_len, obj);
+    if (res == TEE_SUCCESS) {
+        Comsst_FilterAdd(item);
+    }
 
 exit:
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
+    if (attrs != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(attrs);
+    }
+
     return res;
 }
 
-static TEE_Result Comsst_WriteItem(uint32_t param_types __unused,
-    TEE_Param params[4] __unused)
+/*
+ * Get the "scope + name" of an enumerated object into name, which holds
+ * COMSST_NAME_MAX bytes. It is the ID of the object unless the IDs are
+ * hashed, or is split, see Comsst_SplitId().
+ */
+
+static TEE_Result Comsst_EnumName(uint32_t storage, const uint8_t* id,
+    size_t id_len, uint8_t* name, size_t* name_len)
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
     TEE_ObjectHandle obj;
+    TEE_Result res;
 
-    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
-        TEE_PARAM_TYPE_MEMREF_INPUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+    if (COMSST_PACKED && !Comsst_PackIsId(id, id_len)) {
+        if (id_len < COMSST_SPLIT_SUFFIX_LEN
+            || id[id_len - COMSST_SPLIT_SUFFIX_LEN] != '\0') {
+            return TEE_ERROR_BAD_FORMAT;
+        }
 
-    if (param_types != exp_param_types) {
-        EMSG("718fc92c\n");
-        return TEE_ERROR_BAD_PARAMETERS;
+        id_len -= COMSST_SPLIT_SUFFIX_LEN;
     }
 
-    DMSG("TEE_CreatePersistentObject...\n");
-
-    if (params[0].value.b == 0) {
-        res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-            params[1].memref.buffer, params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
-            NULL, 0, &obj);
-    } else {
-        res = TEE_CreatePersistentObject(TEE_STORAGE_USER,
-            params[1].memref.buffer, params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
-            NULL, 0, &obj);
+    if (!COMSST_HASHED) {
+        memcpy(name, id, id_len);
+        *name_len = id_len;
+        return TEE_SUCCESS;
     }
 
+    res = TEE_OpenPersistentObject(storage, id, id_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
     if (res != TEE_SUCCESS) {
-        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
         return res;
     }
 
-    DMSG("TEE_WriteObjectData()...\n");
-
-    res = TEE_WriteObjectData(obj, params[1].memref.buffer + params[0].value.a,
-        params[1].memref.size - params[0].value.a);
-
-    DMSG("TEE_CloseObject()...\n");
+    *name_len = COMSST_NAME_MAX;
+    res = TEE_GetObjectBufferAttribute(obj, TEE_ATTR_SECRET_VALUE, name,
+        name_len);
     TEE_CloseObject(obj);
     return res;
 }
 
-static TEE_Result Comsst_VerifyItem(uint32_t param_types __unused,
-    TEE_Param params[4] __unused)
+static TEE_Result Comsst_GetItem(uint32_t param_types, TEE_Param params[4],
+    uint32_t value_type, uint32_t data_type, struct comsst_item* item)
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-
-    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
-        TEE_PARAM_TYPE_MEMREF_INPUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+    uint32_t packed_types = TEE_PARAM_TYPES(value_type, data_type,
+        TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t split_types = TEE_PARAM_TYPES(value_type,
+        TEE_PARAM_TYPE_MEMREF_INPUT, data_type, TEE_PARAM_TYPE_NONE);
 
-    size_t read_len;
-    static uint8_t data[512];
+    if (param_types == packed_types) {
+        item->split = false;
+    } else if (param_types == split_types) {
+        item->split = true;
+    } else {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
 
-    if (param_types != exp_param_types || params[0].value.a > sizeof(data)) {
-        EMSG("718fc92c\n");
+    if (params[0].value.a > params[1].memref.size
+        || params[0].value.a > sizeof(item->fullname)
+        || COMSST_ITEM_SCOPE_LEN(params[0].value.b) > params[0].value.a) {
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_OpenPersistentObject...\n");
+    item->storage = (params[0].value.b & COMSST_ITEM_DELETABLE)
+        ? TEE_STORAGE_USER
+        : TEE_STORAGE_PRIVATE;
+    memcpy(item->fullname, params[1].memref.buffer, params[0].value.a);
+    item->fullname_len = params[0].value.a;
+    item->scope_len = COMSST_ITEM_SCOPE_LEN(params[0].value.b);
+    item->flags = params[0].value.b;
 
-    if (params[0].value.b == 0) {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
-    } else {
-        res = TEE_OpenPersistentObject(TEE_STORAGE_USER,
-            params[1].memref.buffer,
-            params[0].value.a,
-            TEE_DATA_FLAG_ACCESS_READ,
-            &obj);
-    }
+    /* The ID of the container of the scope must fit in an object ID */
 
-    if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
-        return res;
+    if (COMSST_PACKED
+        && item->scope_len + COMSST_PACK_SUFFIX_LEN > TEE_OBJECT_ID_MAX_LEN) {
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_ReadObjectData()...\n");
+    /*
+     * A NUL in the name could make it collide with the ID of a container
+     * or of the journal, which both hold one
+     */
 
-    res = TEE_ReadObjectData(obj, data, sizeof(data), &read_len);
-    if (res != TEE_SUCCESS) {
-        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
-            res, read_len);
-        goto exit;
+    if (memchr(item->fullname, 0, item->fullname_len) != NULL) {
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if (read_len != params[1].memref.size - params[0].value.a) {
-        res = TEE_ERROR_GENERIC;
-        goto exit;
+    if (Comsst_ObjectId(item) != TEE_SUCCESS) {
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    for (int i = 0; i < read_len; i++) {
-        if (data[i] != ((uint8_t*)params[1].memref.buffer)[i + params[0].value.a]) {
-            res = TEE_ERROR_GENERIC;
-            goto exit;
+    if (item->split) {
+        if (data_type == TEE_PARAM_TYPE_VALUE_OUTPUT) {
+            item->data = NULL;
+            item->data_len = 0;
+        } else {
+            item->data = params[2].memref.buffer;
+            item->data_len = params[2].memref.size;
         }
+    } else {
+        item->data = (uint8_t*)params[1].memref.buffer + item->fullname_len;
+        item->data_len = params[1].memref.size - item->fullname_len;
     }
 
-exit:
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
+    return TEE_SUCCESS;
+}
+
+/*
+ * The object of an item starts with a header telling how its data is
+ * stored, see Comsst_ZInfo(), and keeping the SHA-256 digest of the data,
+ * so that the item can be verified without reading it. An object without
+ * one holds the data as is, so the items written before need no rewrite.
+ *
+ * A full write stores the digest with the data, in the one create of the
+ * object. A partial write clears COMSST_Z_DIGEST first, the digest is then
+ * computed from the data and stored again the next time it is needed.
+ *
+ * The codec is the LZ4 block format, small items of configuration compress
+ * well enough with it and it decompresses faster than the storage reads.
+ */
+
+#define COMSST_Z_MAGIC "\0CZ"
+#define COMSST_Z_MAGIC_LEN 3
+
+#define COMSST_Z_NONE 0 /* no header, the data as is */
+#define COMSST_Z_STORED 1 /* the data as is */
+#define COMSST_Z_LZ4 2
+#define COMSST_Z_DIGEST (1 << 7) /* the digest is the one of the data */
+
+struct comsst_z_hdr {
+    uint8_t magic[COMSST_Z_MAGIC_LEN];
+    uint8_t codec; /* COMSST_Z_STORED or COMSST_Z_LZ4, COMSST_Z_DIGEST */
+    uint32_t size; /* of the data once decompressed */
+    uint8_t digest[COMSST_DIGEST_LEN];
+};
+
+#define COMSST_LZ4_HASH_BITS 12
+#define COMSST_LZ4_MIN_MATCH 4
+#define COMSST_LZ4_MF_LIMIT 12 /* no match starts in the last bytes */
+#define COMSST_LZ4_LAST_LITERALS 5 /* nor covers the very last ones */
+#define COMSST_LZ4_MAX_OFFSET 65535
+
+static uint32_t Comsst_Lz4Read32(const uint8_t* p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Write the extra bytes of a length that did not fit its 4 bits */
+
+static uint8_t* Comsst_Lz4Length(uint8_t* op, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+
+    *op++ = len;
+    return op;
+}
+
+/*
+ * Write a sequence of lit_len literals followed by a match, or only the
+ * literals if match_len is 0. Returns NULL if it does not fit before end.
+ */
+
+static uint8_t* Comsst_Lz4Sequence(uint8_t* op, const uint8_t* end,
+    const uint8_t* lit, size_t lit_len, uint32_t offset, size_t match_len)
+{
+    uint8_t* token = op;
+
+    if ((size_t)(end - op)
+        < lit_len + lit_len / 255 + match_len / 255 + 5) {
+        return NULL;
+    }
+
+    op++;
+
+    *token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15) {
+        op = Comsst_Lz4Length(op, lit_len - 15);
+    }
+
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    match_len -= COMSST_LZ4_MIN_MATCH;
+    *token |= match_len >= 15 ? 15 : match_len;
+    if (match_len >= 15) {
+        op = Comsst_Lz4Length(op, match_len - 15);
+    }
+
+    return op;
+}
+
+/*
+ * Compress len bytes of src into at most cap bytes of dst, greedily
+ * matching 4 bytes found through a hash of the positions seen. Returns
+ * the compressed length, 0 if it does not fit.
+ */
+
+static size_t Comsst_Lz4Compress(const uint8_t* src, size_t len,
+    uint8_t* dst, size_t cap)
+{
+    uint32_t* table;
+    uint8_t* op = dst;
+    const uint8_t* end = dst + cap;
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t ref;
+    size_t match_len;
+    uint32_t seq;
+    uint32_t hash;
+
+    table = TEE_Malloc(sizeof(uint32_t) << COMSST_LZ4_HASH_BITS,
+        TEE_MALLOC_FILL_ZERO);
+    if (table == NULL) {
+        return 0;
+    }
+
+    /* A table entry is a position plus one, 0 is none */
+
+    while (len > COMSST_LZ4_MF_LIMIT && pos < len - COMSST_LZ4_MF_LIMIT) {
+        seq = Comsst_Lz4Read32(src + pos);
+        hash = (seq * 2654435761U) >> (32 - COMSST_LZ4_HASH_BITS);
+        ref = table[hash];
+        table[hash] = pos + 1;
+        if (ref == 0 || pos - (ref - 1) > COMSST_LZ4_MAX_OFFSET
+            || Comsst_Lz4Read32(src + ref - 1) != seq) {
+            pos++;
+            continue;
+        }
+
+        ref--;
+        match_len = COMSST_LZ4_MIN_MATCH;
+        while (pos + match_len < len - COMSST_LZ4_LAST_LITERALS
+            && src[ref + match_len] == src[pos + match_len]) {
+            match_len++;
+        }
+
+        op = Comsst_Lz4Sequence(op, end, src + anchor, pos - anchor,
+            pos - ref, match_len);
+        if (op == NULL) {
+            break;
+        }
+
+        pos += match_len;
+        anchor = pos;
+    }
+
+    if (op != NULL) {
+        op = Comsst_Lz4Sequence(op, end, src + anchor, len - anchor, 0, 0);
+    }
+
+    TEE_Free(table);
+    return op != NULL ? (size_t)(op - dst) : 0;
+}
+
+/* Read the extra bytes of a length, false if they run past the end */
+
+static bool Comsst_Lz4ReadLength(const uint8_t* src, size_t len,
+    size_t* pos, size_t* value)
+{
+    uint8_t byte;
+
+    do {
+        if (*pos >= len) {
+            return false;
+        }
+
+        byte = src[(*pos)++];
+        *value += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+/*
+ * Decompress len bytes of src into exactly size bytes of dst. Nothing is
+ * read or written out of the buffers whatever src holds.
+ */
+
+static TEE_Result Comsst_Lz4Decompress(const uint8_t* src, size_t len,
+    uint8_t* dst, size_t size)
+{
+    size_t pos = 0;
+    size_t out = 0;
+    size_t lit_len;
+    size_t match_len;
+    size_t offset;
+    uint8_t token;
+
+    while (pos < len) {
+        token = src[pos++];
+        lit_len = token >> 4;
+        if ((lit_len == 15
+                && !Comsst_Lz4ReadLength(src, len, &pos, &lit_len))
+            || lit_len > len - pos || lit_len > size - out) {
+            return TEE_ERROR_CORRUPT_OBJECT;
+        }
+
+        memcpy(dst + out, src + pos, lit_len);
+        pos += lit_len;
+        out += lit_len;
+
+        /* The last sequence has no match */
+
+        if (pos == len) {
+            break;
+        }
+
+        if (len - pos < 2) {
+            return TEE_ERROR_CORRUPT_OBJECT;
+        }
+
+        offset = src[pos] | (src[pos + 1] << 8);
+        pos += 2;
+        match_len = token & 15;
+        if (offset == 0 || offset > out
+            || (match_len == 15
+                && !Comsst_Lz4ReadLength(src, len, &pos, &match_len))) {
+            return TEE_ERROR_CORRUPT_OBJECT;
+        }
+
+        match_len += COMSST_LZ4_MIN_MATCH;
+        if (match_len > size - out) {
+            return TEE_ERROR_CORRUPT_OBJECT;
+        }
+
+        /* The match may overlap the bytes it produces */
+
+        for (; match_len > 0; match_len--, out++) {
+            dst[out] = dst[out - offset];
+        }
+    }
+
+    return out == size ? TEE_SUCCESS : TEE_ERROR_CORRUPT_OBJECT;
+}
+
+/*
+ * Get what to store for len bytes of data of an item in *buf, header and
+ * digest included. The data, which must not change meanwhile, is
+ * compressed if the item asks for it or it is large enough, and only kept
+ * so if that saves space.
+ */
+
+static TEE_Result Comsst_ZPack(const struct comsst_item* item,
+    const uint8_t* data, size_t len, uint8_t** buf, size_t* buf_len)
+{
+    struct comsst_z_hdr hdr;
+    TEE_Result res;
+    size_t z_len = 0;
+
+    memcpy(hdr.magic, COMSST_Z_MAGIC, COMSST_Z_MAGIC_LEN);
+    hdr.codec = COMSST_Z_STORED | COMSST_Z_DIGEST;
+    hdr.size = len;
+    res = Comsst_Digest(data, len, hdr.digest);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    *buf = TEE_Malloc(sizeof(hdr) + len, TEE_MALLOC_FILL_ZERO);
+    if (*buf == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    if (COMSST_COMPRESS && ((item->flags & COMSST_ITEM_COMPRESS)
+            || len >= COMSST_COMPRESS_MIN)) {
+        z_len = Comsst_Lz4Compress(data, len, *buf + sizeof(hdr), len);
+    }
+
+    if (z_len > 0 && z_len < len) {
+        hdr.codec = COMSST_Z_LZ4 | COMSST_Z_DIGEST;
+        *buf_len = sizeof(hdr) + z_len;
+    } else {
+        memcpy(*buf + sizeof(hdr), data, len);
+        *buf_len = sizeof(hdr) + len;
+    }
+
+    memcpy(*buf, &hdr, sizeof(hdr));
+    return TEE_SUCCESS;
+}
+
+/*
+ * Get the info of an opened object with dataSize set to the length of the
+ * data of the item, and its header in *hdr, whose codec is COMSST_Z_NONE
+ * if it has none. The object is left positioned at the start of the data,
+ * or of the compressed data.
+ */
+
+static TEE_Result Comsst_ZHeader(TEE_ObjectHandle obj, TEE_ObjectInfo* info,
+    struct comsst_z_hdr* hdr)
+{
+    TEE_Result res;
+    size_t read_len = 0;
+    uint8_t codec;
+
+    hdr->codec = COMSST_Z_NONE;
+    res = TEE_GetObjectInfo1(obj, info);
+    if (res != TEE_SUCCESS) {
+        EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    if (info->dataSize < sizeof(*hdr)) {
+        return TEE_SUCCESS;
+    }
+
+    res = TEE_ReadObjectData(obj, hdr, sizeof(*hdr), &read_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n", res, read_len);
+        hdr->codec = COMSST_Z_NONE;
+        return res;
+    }
+
+    codec = hdr->codec & ~COMSST_Z_DIGEST;
+    if (memcmp(hdr->magic, COMSST_Z_MAGIC, COMSST_Z_MAGIC_LEN) == 0
+        && codec == COMSST_Z_STORED) {
+        info->dataSize -= sizeof(*hdr);
+        return TEE_SUCCESS;
+    } else if (memcmp(hdr->magic, COMSST_Z_MAGIC, COMSST_Z_MAGIC_LEN) == 0
+        && codec == COMSST_Z_LZ4) {
+        info->dataSize = hdr->size;
+        return TEE_SUCCESS;
+    }
+
+    hdr->codec = COMSST_Z_NONE;
+    res = TEE_SeekObjectData(obj, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS) {
+        EMSG("3f8a61c5:0x%08" PRIx32 "\n", res);
+    }
+
+    return res;
+}
+
+/* Same as Comsst_ZHeader(), only telling how the data is stored */
+
+static TEE_Result Comsst_ZInfo(TEE_ObjectHandle obj, TEE_ObjectInfo* info,
+    uint8_t* codec)
+{
+    struct comsst_z_hdr hdr;
+    TEE_Result res;
+
+    res = Comsst_ZHeader(obj, info, &hdr);
+    *codec = hdr.codec & ~COMSST_Z_DIGEST;
+    return res;
+}
+
+/*
+ * Read the whole data of the item, size bytes as returned by
+ * Comsst_ZInfo(), into data
+ */
+
+static TEE_Result Comsst_ZRead(TEE_ObjectHandle obj, uint8_t codec,
+    uint8_t* data, size_t size)
+{
+    TEE_ObjectInfo info;
+    TEE_Result res;
+    uint8_t* buf = data;
+    size_t len = size;
+    size_t read_len = 0;
+
+    if (codec == COMSST_Z_LZ4) {
+        res = TEE_GetObjectInfo1(obj, &info);
+        if (res != TEE_SUCCESS) {
+            EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+            return res;
+        }
+
+        len = info.dataSize - sizeof(struct comsst_z_hdr);
+        buf = TEE_Malloc(len + 1, TEE_MALLOC_FILL_ZERO);
+        if (buf == NULL) {
+            return TEE_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    DMSG("TEE_ReadObjectData()...\n");
+
+    res = TEE_ReadObjectData(obj, buf, len, &read_len);
+    if (res == TEE_SUCCESS && read_len != len) {
+        res = TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    if (res != TEE_SUCCESS) {
+        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n", res, read_len);
+    } else if (codec == COMSST_Z_LZ4) {
+        res = Comsst_Lz4Decompress(buf, len, data, size);
+        if (res != TEE_SUCCESS) {
+            EMSG("5d0c9b2e:0x%08" PRIx32 "\n", res);
+        }
+    }
+
+    if (buf != data) {
+        TEE_Free(buf);
+    }
+
+    return res;
+}
+
+/* Same as Comsst_ZRead(), into a new buffer */
+
+static TEE_Result Comsst_ZAlloc(TEE_ObjectHandle obj, uint8_t codec,
+    size_t size, uint8_t** data)
+{
+    TEE_Result res;
+
+    *data = TEE_Malloc(size + 1, TEE_MALLOC_FILL_ZERO);
+    if (*data == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    res = Comsst_ZRead(obj, codec, *data, size);
+    if (res != TEE_SUCCESS) {
+        TEE_Free(*data);
+        *data = NULL;
+    }
+
+    return res;
+}
+
+/*
+ * Set the digest in the header of an opened object to the one of its data,
+ * or mark it as not matching the data with a NULL digest. The object is
+ * left positioned at the start of the data.
+ */
+
+static TEE_Result Comsst_ZDigestStore(TEE_ObjectHandle obj,
+    struct comsst_z_hdr* hdr, const uint8_t* digest)
+{
+    TEE_Result res;
+
+    if (digest != NULL) {
+        hdr->codec |= COMSST_Z_DIGEST;
+        memcpy(hdr->digest, digest, COMSST_DIGEST_LEN);
+    } else {
+        hdr->codec &= ~COMSST_Z_DIGEST;
+    }
+
+    res = TEE_SeekObjectData(obj, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS) {
+        EMSG("3f8a61c5:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    res = TEE_WriteObjectData(obj, hdr, sizeof(*hdr));
+    if (res != TEE_SUCCESS) {
+        EMSG("7b12e0d6:0x%08" PRIx32 "\n", res);
+    }
+
+    return res;
+}
+
+/*
+ * Make the object of an item, opened for writing, hold its data as is
+ * behind a COMSST_Z_STORED header without a digest, unless the range at
+ * offset can be written to it as it is. *base is where the data starts in
+ * the object.
+ */
+
+static TEE_Result Comsst_ZUnpack(const struct comsst_item* item,
+    TEE_ObjectHandle* obj, uint32_t offset, size_t* base)
+{
+    struct comsst_z_hdr hdr;
+    TEE_ObjectInfo info;
+    TEE_Result res;
+    uint8_t* data;
+    uint8_t* buf;
+    uint8_t codec;
+
+    *base = 0;
+    res = Comsst_ZHeader(*obj, &info, &hdr);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    /* Bytes written past the magic can not make the data look like one */
+
+    codec = hdr.codec & ~COMSST_Z_DIGEST;
+    if (codec == COMSST_Z_STORED && !(hdr.codec & COMSST_Z_DIGEST)) {
+        *base = sizeof(hdr);
+        return TEE_SUCCESS;
+    } else if (codec == COMSST_Z_STORED) {
+        *base = sizeof(hdr);
+        return Comsst_ZDigestStore(*obj, &hdr, NULL);
+    } else if (codec == COMSST_Z_NONE && offset >= COMSST_Z_MAGIC_LEN) {
+        return TEE_SUCCESS;
+    }
+
+    res = Comsst_ZAlloc(*obj, codec, info.dataSize, &data);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    buf = TEE_Malloc(sizeof(hdr) + info.dataSize, TEE_MALLOC_FILL_ZERO);
+    if (buf == NULL) {
+        TEE_Free(data);
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COMSST_Z_MAGIC, COMSST_Z_MAGIC_LEN);
+    hdr.codec = COMSST_Z_STORED;
+    hdr.size = info.dataSize;
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), data, info.dataSize);
+    TEE_Free(data);
+
+    /* The object is replaced as a whole, it can not stay open meanwhile */
+
+    TEE_CloseObject(*obj);
+    *obj = TEE_HANDLE_NULL;
+    res = Comsst_CreateObject(item, buf, sizeof(hdr) + info.dataSize, obj);
+    TEE_Free(buf);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    *base = sizeof(hdr);
+    return TEE_SUCCESS;
+}
+
+/*
+ * LRU cache of the items recently accessed, it holds at most
+ * CONFIG_TA_COMSST_CACHE_SIZE bytes, bookkeeping included. An entry tells
+ * that an item does not exist, that it exists, or holds its whole data.
+ *
+ * Only this TA accesses its storage, so the cache stays coherent as long
+ * as every command changing an item drops or updates its entry. The data
+ * is only ever filled from the storage, never from shared memory.
+ */
+
+#define COMSST_CACHE_ABSENT 0
+#define COMSST_CACHE_PRESENT 1
+#define COMSST_CACHE_DATA 2
+
+struct comsst_cache_entry {
+    struct comsst_cache_entry* prev;
+    struct comsst_cache_entry* next;
+    uint32_t storage;
+    uint32_t state;
+    size_t id_len;
+    size_t data_len;
+    uint8_t buf[]; /* id followed by data */
+};
+
+static struct {
+    struct comsst_cache_entry* head; /* most recently used */
+    struct comsst_cache_entry* tail;
+    size_t used;
+} g_comsst_cache;
+
+static size_t Comsst_CacheCost(size_t id_len, size_t data_len)
+{
+    return sizeof(struct comsst_cache_entry) + id_len + data_len;
+}
+
+static uint8_t* Comsst_CacheData(struct comsst_cache_entry* entry)
+{
+    return entry->buf + entry->id_len;
+}
+
+static void Comsst_CacheUnlink(struct comsst_cache_entry* entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        g_comsst_cache.head = entry->next;
+    }
+
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        g_comsst_cache.tail = entry->prev;
+    }
+}
+
+static void Comsst_CacheLink(struct comsst_cache_entry* entry)
+{
+    entry->prev = NULL;
+    entry->next = g_comsst_cache.head;
+    if (g_comsst_cache.head != NULL) {
+        g_comsst_cache.head->prev = entry;
+    } else {
+        g_comsst_cache.tail = entry;
+    }
+
+    g_comsst_cache.head = entry;
+}
+
+static void Comsst_CacheRemove(struct comsst_cache_entry* entry)
+{
+    Comsst_CacheUnlink(entry);
+    g_comsst_cache.used -= Comsst_CacheCost(entry->id_len, entry->data_len);
+    TEE_Free(entry);
+}
+
+static void Comsst_CacheFlush(void)
+{
+    while (g_comsst_cache.head != NULL) {
+        Comsst_CacheRemove(g_comsst_cache.head);
+    }
+}
+
+/*
+ * The entries are found by the "scope + name" of the items, or by their
+ * split ID with the packed layout, see Comsst_SplitId(). Both start with
+ * the "scope + name", as Comsst_CacheDropPrefix() expects.
+ */
+
+static const uint8_t* Comsst_CacheKey(const struct comsst_item* item,
+    size_t* key_len)
+{
+    if (COMSST_PACKED) {
+        *key_len = item->name_len;
+        return item->name;
+    }
+
+    *key_len = item->fullname_len;
+    return item->fullname;
+}
+
+/* Find the entry of the item and make it the most recently used one */
+
+static struct comsst_cache_entry* Comsst_CacheFind(
+    const struct comsst_item* item)
+{
+    struct comsst_cache_entry* entry;
+    size_t key_len;
+    const uint8_t* key = Comsst_CacheKey(item, &key_len);
+
+    for (entry = g_comsst_cache.head; entry != NULL; entry = entry->next) {
+        if (entry->storage == item->storage && entry->id_len == key_len
+            && memcmp(entry->buf, key, key_len) == 0) {
+            Comsst_CacheUnlink(entry);
+            Comsst_CacheLink(entry);
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void Comsst_CacheDrop(const struct comsst_item* item)
+{
+    struct comsst_cache_entry* entry = Comsst_CacheFind(item);
+
+    if (entry != NULL) {
+        Comsst_CacheRemove(entry);
+    }
+}
+
+/* Drop the entries of every item whose ID starts with prefix */
+
+static void Comsst_CacheDropPrefix(uint32_t storage, const uint8_t* prefix,
+    size_t prefix_len)
+{
+    struct comsst_cache_entry* entry = g_comsst_cache.head;
+    struct comsst_cache_entry* next;
+
+    while (entry != NULL) {
+        next = entry->next;
+        if (entry->storage == storage && entry->id_len >= prefix_len
+            && memcmp(entry->buf, prefix, prefix_len) == 0) {
+            Comsst_CacheRemove(entry);
+        }
+
+        entry = next;
+    }
+}
+
+/*
+ * Replace the entry of the item with a new one in the given state, with
+ * room for data_len bytes of data. Returns NULL if it does not fit in the
+ * cache.
+ */
+
+static struct comsst_cache_entry* Comsst_CacheAdd(
+    const struct comsst_item* item, uint32_t state, size_t data_len)
+{
+    struct comsst_cache_entry* entry;
+    size_t key_len;
+    const uint8_t* key = Comsst_CacheKey(item, &key_len);
+    size_t cost = Comsst_CacheCost(key_len, data_len);
+
+    Comsst_CacheDrop(item);
+    if (cost > CONFIG_TA_COMSST_CACHE_SIZE) {
+        return NULL;
+    }
+
+    while (g_comsst_cache.used + cost > CONFIG_TA_COMSST_CACHE_SIZE) {
+        Comsst_CacheRemove(g_comsst_cache.tail);
+    }
+
+    entry = TEE_Malloc(cost, TEE_MALLOC_FILL_ZERO);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->storage = item->storage;
+    entry->state = state;
+    entry->id_len = key_len;
+    entry->data_len = data_len;
+    memcpy(entry->buf, key, key_len);
+    Comsst_CacheLink(entry);
+    g_comsst_cache.used += cost;
+    return entry;
+}
+
+/*
+ * Read the whole data of the opened item into a new entry, *entry is set
+ * to NULL if the item does not fit in the cache. *info and *codec are the
+ * ones of Comsst_ZInfo().
+ */
+
+static TEE_Result Comsst_CacheLoad(TEE_ObjectHandle obj,
+    const struct comsst_item* item, TEE_ObjectInfo* info, uint8_t* codec,
+    struct comsst_cache_entry** entry)
+{
+    TEE_Result res;
+
+    res = Comsst_ZInfo(obj, info, codec);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    *entry = Comsst_CacheAdd(item, COMSST_CACHE_DATA, info->dataSize);
+    if (*entry == NULL) {
+        return TEE_SUCCESS;
+    }
+
+    res = Comsst_ZRead(obj, *codec, Comsst_CacheData(*entry),
+        info->dataSize);
+    if (res != TEE_SUCCESS) {
+        Comsst_CacheRemove(*entry);
+        *entry = NULL;
+    }
+
+    return res;
+}
+
+/*
+ * Log why an item could not be opened, and remember that it does not
+ * exist if the storage said so
+ */
+
+static void Comsst_OpenFailed(const struct comsst_item* item,
+    TEE_Result res)
+{
+    /* A missing item is an answer, not an error worth a log line */
+
+    if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+    }
+
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        Comsst_CacheAdd(item, COMSST_CACHE_ABSENT, 0);
+    } else {
+        Comsst_CacheDrop(item);
+    }
+}
+
+/*
+ * Give the data of an item held in memory to the client, like
+ * Comsst_ReadItem()
+ */
+
+static void Comsst_ReplyData(const uint8_t* data, size_t data_len,
+    const struct comsst_item* item, TEE_Param params[4])
+{
+    if (data_len <= item->data_len) {
+        memcpy(item->data, data, data_len);
+    }
+
+    params[0].value.b = data_len;
+}
+
+/*
+ * With the packed layout, the items of at most COMSST_PACKED_ITEM_MAX
+ * bytes of a scope are kept together in one container object, so that
+ * hundreds of small items do not each pay for an object of their own.
+ * The ID of the container is the scope followed by COMSST_PACK_SUFFIX,
+ * which no item name can end with as names hold no NUL.
+ *
+ * A container is a struct comsst_pack_hdr, the index of its items, then
+ * the records of the items, each one the name without the scope followed
+ * by the data. The records are kept back to back, the container is
+ * rewritten in one go whenever an item changes, so a delete compacts it.
+ *
+ * An item is either in the container of its scope or an object of its
+ * own, never both. The container is looked up first.
+ */
+
+#define COMSST_PACK_MAGIC 0x4b435043
+
+struct comsst_pack_hdr {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct comsst_pack_index {
+    uint32_t hash; /* of the name without the scope */
+    uint32_t offset; /* of the record, from the end of the index */
+    uint16_t name_len;
+    uint16_t data_len;
+};
+
+struct comsst_pack {
+    uint8_t* buf;
+    size_t size;
+    uint32_t count;
+    struct comsst_pack_index* index;
+    uint8_t* records;
+    uint32_t flags;
+};
+
+/* FNV-1a */
+
+static uint32_t Comsst_PackHash(const uint8_t* name, size_t len)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    while (len-- > 0) {
+        hash = (hash ^ *name++) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static bool Comsst_PackIsId(const uint8_t* id, size_t id_len)
+{
+    return id_len >= COMSST_PACK_SUFFIX_LEN
+        && memcmp(id + id_len - COMSST_PACK_SUFFIX_LEN, COMSST_PACK_SUFFIX,
+               COMSST_PACK_SUFFIX_LEN)
+        == 0;
+}
+
+static void Comsst_PackId(const struct comsst_item* item, uint8_t* id,
+    size_t* id_len)
+{
+    memcpy(id, item->fullname, item->scope_len);
+    memcpy(id + item->scope_len, COMSST_PACK_SUFFIX, COMSST_PACK_SUFFIX_LEN);
+    *id_len = item->scope_len + COMSST_PACK_SUFFIX_LEN;
+}
+
+static const uint8_t* Comsst_PackData(const struct comsst_pack* pack,
+    uint32_t idx)
+{
+    return pack->records + pack->index[idx].offset
+        + pack->index[idx].name_len;
+}
+
+static void Comsst_PackFree(struct comsst_pack* pack)
+{
+    TEE_Free(pack->buf);
+    pack->buf = NULL;
+}
+
+/* Check that the index does not point out of the container */
+
+static TEE_Result Comsst_PackParse(struct comsst_pack* pack)
+{
+    struct comsst_pack_hdr* hdr = (struct comsst_pack_hdr*)pack->buf;
+    size_t left;
+    uint32_t i;
+
+    if (pack->size < sizeof(*hdr) || hdr->magic != COMSST_PACK_MAGIC) {
+        return TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    left = pack->size - sizeof(*hdr);
+    if (hdr->count > left / sizeof(struct comsst_pack_index)) {
+        return TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    pack->count = hdr->count;
+    pack->index = (struct comsst_pack_index*)(hdr + 1);
+    pack->records = (uint8_t*)(pack->index + pack->count);
+    left -= pack->count * sizeof(struct comsst_pack_index);
+
+    for (i = 0; i < pack->count; i++) {
+        if (pack->index[i].offset > left
+            || (size_t)pack->index[i].name_len + pack->index[i].data_len
+                > left - pack->index[i].offset) {
+            return TEE_ERROR_CORRUPT_OBJECT;
+        }
+    }
+
+    return TEE_SUCCESS;
+}
+
+/* Read a whole container, a missing one is returned empty */
+
+static TEE_Result Comsst_PackLoad(uint32_t storage, const uint8_t* id,
+    size_t id_len, struct comsst_pack* pack)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    size_t read_len;
+
+    memset(pack, 0, sizeof(*pack));
+
+    res = TEE_OpenPersistentObject(storage, id, id_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        return TEE_SUCCESS;
+    } else if (res != TEE_SUCCESS) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    res = TEE_GetObjectInfo1(obj, &info);
+    if (res != TEE_SUCCESS) {
+        EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    pack->buf = TEE_Malloc(info.dataSize + 1, TEE_MALLOC_FILL_ZERO);
+    if (pack->buf == NULL) {
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    pack->size = info.dataSize;
+    pack->flags = info.handleFlags;
+
+    res = TEE_ReadObjectData(obj, pack->buf, pack->size, &read_len);
+    if (res == TEE_SUCCESS && read_len != pack->size) {
+        res = TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    if (res == TEE_SUCCESS) {
+        res = Comsst_PackParse(pack);
+    }
+
+    if (res != TEE_SUCCESS) {
+        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
+            res, read_len);
+        Comsst_PackFree(pack);
+    }
+
+exit:
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/* Returns the position of the item in the index, or -1 */
+
+static int32_t Comsst_PackFind(const struct comsst_pack* pack,
+    const struct comsst_item* item)
+{
+    const uint8_t* name = item->fullname + item->scope_len;
+    size_t name_len = item->fullname_len - item->scope_len;
+    uint32_t hash = Comsst_PackHash(name, name_len);
+    uint32_t i;
+
+    for (i = 0; i < pack->count; i++) {
+        if (pack->index[i].hash == hash
+            && pack->index[i].name_len == name_len
+            && memcmp(pack->records + pack->index[i].offset, name, name_len)
+                == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Load the container of the scope of the item and find the item in it,
+ * the container is only kept, and must be freed, if the item is found
+ */
+
+static TEE_Result Comsst_PackGet(const struct comsst_item* item,
+    struct comsst_pack* pack, int32_t* idx)
+{
+    TEE_Result res;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+
+    Comsst_PackId(item, id, &id_len);
+    res = Comsst_PackLoad(item->storage, id, id_len, pack);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    *idx = Comsst_PackFind(pack, item);
+    if (*idx < 0) {
+        Comsst_PackFree(pack);
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * Build in *buf the container of the scope of the item with the item at
+ * skip removed, then data added as the item if add is set. *size is 0 if
+ * the container ends up empty.
+ */
+
+static TEE_Result Comsst_PackBuild(const struct comsst_item* item,
+    const struct comsst_pack* pack, int32_t skip, const void* data,
+    size_t data_len, bool add, uint8_t** buf, size_t* size)
+{
+    struct comsst_pack_hdr* hdr;
+    struct comsst_pack_index* index;
+    uint8_t* records;
+    size_t name_len = item->fullname_len - item->scope_len;
+    size_t offset = 0;
+    size_t rec_len;
+    uint32_t count = 0;
+    uint32_t i;
+
+    *size = sizeof(*hdr);
+    for (i = 0; i < pack->count; i++) {
+        if ((int32_t)i != skip) {
+            *size += sizeof(*index) + pack->index[i].name_len
+                + pack->index[i].data_len;
+            count++;
+        }
+    }
+
+    if (add) {
+        *size += sizeof(*index) + name_len + data_len;
+        count++;
+    }
+
+    if (count == 0) {
+        *buf = NULL;
+        *size = 0;
+        return TEE_SUCCESS;
+    }
+
+    *buf = TEE_Malloc(*size, TEE_MALLOC_FILL_ZERO);
+    if (*buf == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    hdr = (struct comsst_pack_hdr*)*buf;
+    hdr->magic = COMSST_PACK_MAGIC;
+    hdr->count = count;
+    index = (struct comsst_pack_index*)(hdr + 1);
+    records = (uint8_t*)(index + count);
+
+    for (i = 0; i < pack->count; i++) {
+        if ((int32_t)i == skip) {
+            continue;
+        }
+
+        rec_len = pack->index[i].name_len + pack->index[i].data_len;
+        *index = pack->index[i];
+        index->offset = offset;
+        memcpy(records + offset, pack->records + pack->index[i].offset,
+            rec_len);
+        offset += rec_len;
+        index++;
+    }
+
+    if (add) {
+        index->hash = Comsst_PackHash(item->fullname + item->scope_len,
+            name_len);
+        index->offset = offset;
+        index->name_len = name_len;
+        index->data_len = data_len;
+        memcpy(records + offset, item->fullname + item->scope_len,
+            name_len);
+        memcpy(records + offset + name_len, data, data_len);
+    }
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * Replace the container of the scope of the item with the size bytes of
+ * buf, or delete it if size is 0
+ */
+
+static TEE_Result Comsst_PackWrite(const struct comsst_item* item,
+    const uint8_t* buf, size_t size)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+
+    Comsst_PackId(item, id, &id_len);
+
+    if (size == 0) {
+        res = TEE_OpenPersistentObject(item->storage, id, id_len,
+            TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+        if (res == TEE_SUCCESS) {
+            res = TEE_CloseAndDeletePersistentObject1(obj);
+        }
+
+        return res == TEE_ERROR_ITEM_NOT_FOUND ? TEE_SUCCESS : res;
+    }
+
+    /* Creating the object with its data replaces the old one atomically */
+
+    res = TEE_CreatePersistentObject(item->storage, id, id_len,
+        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
+        buf, size, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    TEE_CloseObject(obj);
+    return TEE_SUCCESS;
+}
+
+/*
+ * Rewrite the container of the scope of the item with the item at skip
+ * removed, then data added as the item if add is set. The container is
+ * deleted once it is empty.
+ */
+
+static TEE_Result Comsst_PackStore(const struct comsst_item* item,
+    const struct comsst_pack* pack, int32_t skip, const void* data,
+    size_t data_len, bool add)
+{
+    TEE_Result res;
+    uint8_t* buf;
+    size_t size;
+
+    res = Comsst_PackBuild(item, pack, skip, data, data_len, add, &buf,
+        &size);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    res = Comsst_PackWrite(item, buf, size);
+    if (res == TEE_SUCCESS && add) {
+        Comsst_FilterAdd(item);
+    }
+
+    TEE_Free(buf);
+    return res;
+}
+
+/* Remove the item from the container of its scope, if it is there */
+
+static TEE_Result Comsst_PackRemove(const struct comsst_item* item)
+{
+    struct comsst_pack pack;
+    int32_t idx;
+    TEE_Result res;
+
+    res = Comsst_PackGet(item, &pack, &idx);
+    if (res == TEE_SUCCESS) {
+        res = Comsst_PackStore(item, &pack, idx, NULL, 0, false);
+        Comsst_PackFree(&pack);
+    }
+
+    return res;
+}
+
+/* Put the data of the item in the container of its scope */
+
+static TEE_Result Comsst_PackPut(const struct comsst_item* item,
+    const void* data, size_t data_len)
+{
+    struct comsst_pack pack;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+    TEE_Result res;
+
+    Comsst_PackId(item, id, &id_len);
+    res = Comsst_PackLoad(item->storage, id, id_len, &pack);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    res = Comsst_PackStore(item, &pack, Comsst_PackFind(&pack, item), data,
+        data_len, true);
+    Comsst_PackFree(&pack);
+    return res;
+}
+
+/* Keep a copy of the data of a packed item in the cache */
+
+static void Comsst_PackCache(const struct comsst_item* item,
+    const struct comsst_pack* pack, int32_t idx)
+{
+    struct comsst_cache_entry* entry;
+
+    entry = Comsst_CacheAdd(item, COMSST_CACHE_DATA,
+        pack->index[idx].data_len);
+    if (entry != NULL) {
+        memcpy(Comsst_CacheData(entry), Comsst_PackData(pack, idx),
+            entry->data_len);
+    }
+}
+
+/*
+ * The SHA-256 digest of the data of an item, with the length of the data.
+ * An item that has an object of its own keeps it in the header of the
+ * object, see Comsst_ZPack(). Packed and cached items are hashed from
+ * memory instead.
+ */
+
+struct comsst_digest {
+    uint32_t size;
+    uint8_t digest[COMSST_DIGEST_LEN];
+};
+
+/* The journal of a transaction, see Comsst_TxnCommit() */
+
+#define COMSST_JOURNAL_ID "\0J"
+#define COMSST_JOURNAL_ID_LEN 2
+
+/* Objects of the TA itself, which are not items */
+
+static bool Comsst_IsMetaId(const uint8_t* id, size_t id_len)
+{
+    return id_len == COMSST_JOURNAL_ID_LEN
+        && memcmp(id, COMSST_JOURNAL_ID, COMSST_JOURNAL_ID_LEN) == 0;
+}
+
+static TEE_Result Comsst_DigestData(const void* data, size_t len,
+    struct comsst_digest* digest)
+{
+    digest->size = len;
+    return Comsst_Digest(data, len, digest->digest);
+}
+
+/* Hash the data of an open object from its current position to its end */
+
+static TEE_Result Comsst_DigestObject(TEE_ObjectHandle obj,
+    struct comsst_digest* digest)
+{
+    TEE_OperationHandle op;
+    TEE_Result res;
+    uint8_t data[COMSST_DIGEST_CHUNK];
+    size_t read_len;
+    size_t digest_len = sizeof(digest->digest);
+
+    res = Comsst_DigestOp(&op);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    digest->size = 0;
+    do {
+        res = TEE_ReadObjectData(obj, data, sizeof(data), &read_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n", res, read_len);
+            return res;
+        }
+
+        TEE_DigestUpdate(op, data, read_len);
+        digest->size += read_len;
+    } while (read_len == sizeof(data));
+
+    res = TEE_DigestDoFinal(op, NULL, 0, digest->digest, &digest_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("f6d3092e:0x%08" PRIx32 "\n", res);
+    }
+
+    return res;
+}
+
+/*
+ * Existence filter of the items of each storage, so that looking an item
+ * up that does not exist, the most common answer of a check, does not
+ * touch the storage. It is a Bloom filter of CONFIG_TA_COMSST_FILTER_BITS
+ * bits over the object IDs, or the would-be object IDs of packed items,
+ * built by enumerating the storage the first time it is needed.
+ *
+ * Every command creating an item sets its bits, see Comsst_CreateObject()
+ * and Comsst_PackStore(). Deleted items leave their bits set, which only
+ * costs a storage access when they are looked up again, so the filter is
+ * built again once they are many. A scope clear drops the filter of its
+ * storage at once.
+ *
+ * A storage the filter can not be built from, e.g. because one of its
+ * containers is corrupt, is not enumerated again on every lookup: the
+ * filter stays off until the next item created or scope cleared in it.
+ */
+
+#define COMSST_FILTER_PROBES 4
+#define COMSST_FILTER_STALE 32
+
+struct comsst_filter {
+    uint8_t* bits;
+    uint32_t added;
+    uint32_t removed;
+    bool failed;
+};
+
+static struct comsst_filter g_comsst_filter[2];
+
+static struct comsst_filter* Comsst_Filter(uint32_t storage)
+{
+    return &g_comsst_filter[storage == TEE_STORAGE_USER];
+}
+
+/* Set the bits of key, or tell whether they are all set */
+
+static bool Comsst_FilterProbe(struct comsst_filter* filter,
+    const uint8_t* key, size_t key_len, bool set)
+{
+    uint32_t hash = Comsst_PackHash(key, key_len);
+    uint32_t step = ((hash >> 17) | (hash << 15)) | 1;
+    uint32_t bit;
+    uint32_t i;
+
+    for (i = 0; i < COMSST_FILTER_PROBES; i++) {
+        bit = (hash + i * step) % COMSST_FILTER_BITS;
+        if (set) {
+            filter->bits[bit / 8] |= 1 << (bit % 8);
+        } else if (!(filter->bits[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void Comsst_FilterReset(uint32_t storage)
+{
+    struct comsst_filter* filter = Comsst_Filter(storage);
+
+    TEE_Free(filter->bits);
+    filter->bits = NULL;
+    filter->failed = false;
+}
+
+static void Comsst_FilterFree(void)
+{
+    Comsst_FilterReset(TEE_STORAGE_PRIVATE);
+    Comsst_FilterReset(TEE_STORAGE_USER);
+}
+
+/* Set the bits of the items of a container */
+
+static TEE_Result Comsst_FilterPack(struct comsst_filter* filter,
+    uint32_t storage, const uint8_t* id, size_t id_len)
+{
+    TEE_Result res;
+    struct comsst_pack pack;
+    uint8_t fullname[TEE_OBJECT_ID_MAX_LEN];
+    uint8_t split_id[TEE_OBJECT_ID_MAX_LEN];
+    size_t scope_len = id_len - COMSST_PACK_SUFFIX_LEN;
+    size_t fullname_len;
+    size_t split_id_len;
+    uint32_t i;
+
+    res = Comsst_PackLoad(storage, id, id_len, &pack);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    /* The filter holds the IDs of the items, see Comsst_FilterMiss() */
+
+    memcpy(fullname, id, scope_len);
+    for (i = 0; i < pack.count; i++) {
+        fullname_len = scope_len + pack.index[i].name_len;
+        if (fullname_len + COMSST_SPLIT_SUFFIX_LEN > sizeof(split_id)) {
+            continue;
+        }
+
+        memcpy(fullname + scope_len, pack.records + pack.index[i].offset,
+            pack.index[i].name_len);
+        Comsst_SplitId(fullname, fullname_len, scope_len, split_id,
+            &split_id_len);
+        Comsst_FilterProbe(filter, split_id, split_id_len, true);
+        filter->added++;
+    }
+
+    Comsst_PackFree(&pack);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_FilterBuild(uint32_t storage)
+{
+    TEE_Result res;
+    TEE_ObjectEnumHandle objenum;
+    TEE_ObjectInfo info;
+    struct comsst_filter* filter = Comsst_Filter(storage);
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+
+    filter->bits = TEE_Malloc((COMSST_FILTER_BITS + 7) / 8,
+        TEE_MALLOC_FILL_ZERO);
+    if (filter->bits == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    filter->added = 0;
+    filter->removed = 0;
+
+    res = TEE_AllocatePersistentObjectEnumerator(&objenum);
+    if (res != TEE_SUCCESS) {
+        EMSG("2e61b0f9:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    /* An empty storage has nothing to enumerate */
+
+    res = TEE_StartPersistentObjectEnumerator(objenum, storage);
+    while (res == TEE_SUCCESS) {
+        id_len = sizeof(id);
+        res = TEE_GetNextPersistentObject(objenum, &info, id, &id_len);
+        if (res != TEE_SUCCESS || Comsst_IsMetaId(id, id_len)) {
+            continue;
+        }
+
+        if (COMSST_PACKED && Comsst_PackIsId(id, id_len)) {
+            res = Comsst_FilterPack(filter, storage, id, id_len);
+        } else {
+            Comsst_FilterProbe(filter, id, id_len, true);
+            filter->added++;
+        }
+    }
+
+    TEE_FreePersistentObjectEnumerator(objenum);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        res = TEE_SUCCESS;
+    } else {
+        EMSG("9c4d7e12:0x%08" PRIx32 "\n", res);
+    }
+
+exit:
+    if (res != TEE_SUCCESS) {
+        Comsst_FilterReset(storage);
+        filter->failed = true;
+    }
+
+    return res;
+}
+
+/*
+ * Tell whether the item surely does not exist. If the filter can not be
+ * built, every item may exist until a change of the storage lets it be
+ * tried again.
+ */
+
+static bool Comsst_FilterMiss(const struct comsst_item* item)
+{
+    struct comsst_filter* filter = Comsst_Filter(item->storage);
+
+    if (!COMSST_FILTER) {
+        return false;
+    }
+
+    if (filter->bits != NULL && filter->removed >= COMSST_FILTER_STALE
+        && filter->removed * 2 >= filter->added) {
+        Comsst_FilterReset(item->storage);
+    }
+
+    if (filter->failed) {
+        return false;
+    }
+
+    if (filter->bits == NULL
+        && Comsst_FilterBuild(item->storage) != TEE_SUCCESS) {
+        return false;
+    }
+
+    return !Comsst_FilterProbe(filter, item->name, item->name_len, false);
+}
+
+static void Comsst_FilterAdd(const struct comsst_item* item)
+{
+    struct comsst_filter* filter = Comsst_Filter(item->storage);
+
+    if (filter->bits != NULL) {
+        Comsst_FilterProbe(filter, item->name, item->name_len, true);
+        filter->added++;
+    }
+
+    /* The write may have replaced what the filter failed on */
+
+    filter->failed = false;
+}
+
+static void Comsst_FilterRemoved(const struct comsst_item* item)
+{
+    Comsst_Filter(item->storage)->removed++;
+}
+
+/*
+ * Get the digest of the data of an item, from memory if the item is
+ * cached or packed, else from the header of its object, where it is
+ * stored from the data of the item if it is missing
+ */
+
+static TEE_Result Comsst_ItemDigest(const struct comsst_item* item,
+    struct comsst_digest* digest)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_cache_entry* entry;
+    struct comsst_pack pack;
+    struct comsst_z_hdr hdr;
+    int32_t idx;
+    uint8_t* data;
+    uint8_t codec;
+
+    entry = Comsst_CacheFind(item);
+    if (entry != NULL && entry->state == COMSST_CACHE_ABSENT) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    } else if (entry != NULL && entry->state == COMSST_CACHE_DATA) {
+        return Comsst_DigestData(Comsst_CacheData(entry), entry->data_len,
+            digest);
+    } else if (entry == NULL && Comsst_FilterMiss(item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            res = Comsst_DigestData(Comsst_PackData(&pack, idx),
+                pack.index[idx].data_len, digest);
+            Comsst_PackFree(&pack);
+            return res;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item->storage, item->name, item->name_len,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(item, res);
+        return res;
+    }
+
+    res = Comsst_ZHeader(obj, &info, &hdr);
+    if (res == TEE_SUCCESS && (hdr.codec & COMSST_Z_DIGEST)) {
+        digest->size = info.dataSize;
+        memcpy(digest->digest, hdr.digest, COMSST_DIGEST_LEN);
+        TEE_CloseObject(obj);
+        return TEE_SUCCESS;
+    }
+
+    codec = hdr.codec & ~COMSST_Z_DIGEST;
+    if (res == TEE_SUCCESS && codec == COMSST_Z_LZ4) {
+        res = Comsst_ZAlloc(obj, codec, info.dataSize, &data);
+        if (res == TEE_SUCCESS) {
+            res = Comsst_DigestData(data, info.dataSize, digest);
+            TEE_Free(data);
+        }
+    } else if (res == TEE_SUCCESS) {
+        res = Comsst_DigestObject(obj, digest);
+    }
+
+    /*
+     * Not keeping the digest only costs hashing the data again next time,
+     * an object without a header has no room for it
+     */
+
+    if (res == TEE_SUCCESS && codec != COMSST_Z_NONE) {
+        Comsst_ZDigestStore(obj, &hdr, digest->digest);
+    }
+
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/* Delete the object of its own the item may have, if any */
+
+static TEE_Result Comsst_DeleteObject(const struct comsst_item* item)
+{
+    TEE_ObjectHandle obj;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(item->storage, item->name, item->name_len,
+        TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        return TEE_SUCCESS;
+    } else if (res != TEE_SUCCESS) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    res = TEE_CloseAndDeletePersistentObject1(obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
+    }
+
+    return res;
+}
+
+/*
+ * Comsst_WriteRange() for a packed item, the item is rebuilt in memory and
+ * moves to an object of its own if it grows out of the container
+ */
+
+static TEE_Result Comsst_PackWriteRange(const struct comsst_item* item,
+    const struct comsst_pack* pack, int32_t idx, bool create, uint32_t offset,
+    uint32_t new_size, uint32_t* size)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    uint8_t* buf;
+    uint8_t* z_buf;
+    size_t z_len;
+    size_t old_len = create ? 0 : pack->index[idx].data_len;
+    size_t len = old_len;
+
+    if (item->data_len > 0) {
+        if (offset > UINT32_MAX - item->data_len) {
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        if (offset + item->data_len > len) {
+            len = offset + item->data_len;
+        }
+    }
+
+    if (new_size != COMSST_PATCH_KEEP_SIZE) {
+        len = new_size;
+    }
+
+    buf = TEE_Malloc(len + 1, TEE_MALLOC_FILL_ZERO);
+    if (buf == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(buf, Comsst_PackData(pack, idx), old_len < len ? old_len : len);
+    if (item->data_len > 0 && offset < len) {
+        memcpy(buf + offset, item->data,
+            item->data_len < len - offset ? item->data_len : len - offset);
+    }
+
+    if (len <= COMSST_PACKED_ITEM_MAX) {
+        res = Comsst_PackStore(item, pack, idx, buf, len, true);
+        goto exit;
+    }
+
+    res = Comsst_ZPack(item, buf, len, &z_buf, &z_len);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    DMSG("TEE_CreatePersistentObject...\n");
+
+    res = Comsst_CreateObject(item, z_buf, z_len, &obj);
+    TEE_Free(z_buf);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    TEE_CloseObject(obj);
+    res = Comsst_PackStore(item, pack, idx, NULL, 0, false);
+
+exit:
+    if (res == TEE_SUCCESS) {
+        *size = len;
+    }
+
+    TEE_Free(buf);
+    return res;
+}
+
+/*
+ * List the items of a container whose full name starts with prefix, from
+ * the one at *sub. Returns TEE_ERROR_SHORT_BUFFER with *sub set to the
+ * first item not listed once the page is full.
+ */
+
+static TEE_Result Comsst_PackList(uint32_t storage, const uint8_t* id,
+    size_t id_len, const uint8_t* prefix, size_t prefix_len, uint8_t* page,
+    size_t page_len, size_t* used, uint32_t* count, uint32_t* sub)
+{
+    TEE_Result res;
+    struct comsst_pack pack;
+    uint8_t fullname[TEE_OBJECT_ID_MAX_LEN];
+    size_t scope_len = id_len - COMSST_PACK_SUFFIX_LEN;
+    size_t fullname_len;
+    size_t rec_len;
+    uint32_t i;
+
+    res = Comsst_PackLoad(storage, id, id_len, &pack);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    memcpy(fullname, id, scope_len);
+    for (i = *sub; i < pack.count; i++) {
+        fullname_len = scope_len + pack.index[i].name_len;
+        if (fullname_len > sizeof(fullname) || fullname_len < prefix_len) {
+            continue;
+        }
+
+        memcpy(fullname + scope_len, pack.records + pack.index[i].offset,
+            pack.index[i].name_len);
+        if (memcmp(fullname, prefix, prefix_len) != 0) {
+            continue;
+        }
+
+        rec_len = 1 + fullname_len - prefix_len;
+        if (*used + rec_len > page_len) {
+            *sub = i;
+            res = TEE_ERROR_SHORT_BUFFER;
+            break;
+        }
+
+        page[*used] = fullname_len - prefix_len;
+        memcpy(page + *used + 1, fullname + prefix_len,
+            fullname_len - prefix_len);
+        *used += rec_len;
+        (*count)++;
+    }
+
+    Comsst_PackFree(&pack);
+    return res;
+}
+
+static TEE_Result Comsst_CheckItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    struct comsst_item item;
+    struct comsst_cache_entry* entry;
+    struct comsst_pack pack;
+    int32_t idx;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, &item)
+            != TEE_SUCCESS
+        || item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    entry = Comsst_CacheFind(&item);
+    if (entry != NULL) {
+        return entry->state == COMSST_CACHE_ABSENT ? TEE_ERROR_ITEM_NOT_FOUND
+                                                   : TEE_SUCCESS;
+    } else if (Comsst_FilterMiss(&item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(&item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            Comsst_PackCache(&item, &pack, idx);
+            Comsst_PackFree(&pack);
+            return TEE_SUCCESS;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item.storage, item.name, item.name_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(&item, res);
+        goto exit;
+    }
+
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+    Comsst_CacheAdd(&item, COMSST_CACHE_PRESENT, 0);
+
+exit:
+    return res;
+}
+
+/* Delete an item, from its container or its own object */
+
+static TEE_Result Comsst_RemoveItem(const struct comsst_item* item)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+
+    if (Comsst_FilterMiss(item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackRemove(item);
+        if (res == TEE_SUCCESS) {
+            Comsst_CacheAdd(item, COMSST_CACHE_ABSENT, 0);
+            Comsst_FilterRemoved(item);
+            return res;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            Comsst_CacheDrop(item);
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item->storage, item->name, item->name_len,
+        TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(item, res);
+        return res;
+    }
+
+    DMSG("TEE_CloseAndDeletePersistentObject1()...\n");
+    res = TEE_CloseAndDeletePersistentObject1(obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
+        Comsst_CacheDrop(item);
+        return res;
+    }
+
+    Comsst_CacheAdd(item, COMSST_CACHE_ABSENT, 0);
+    Comsst_FilterRemoved(item);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_DeleteItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    struct comsst_item item;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, &item)
+            != TEE_SUCCESS
+        || item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    return Comsst_RemoveItem(&item);
+}
+
+static TEE_Result Comsst_ReadItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_item item;
+    struct comsst_cache_entry* entry;
+    struct comsst_pack pack;
+    int32_t idx;
+    uint8_t codec;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INOUT,
+            TEE_PARAM_TYPE_MEMREF_INOUT, &item)
+            == TEE_SUCCESS
+        && !item.split) {
+        /* The packed layout gets the data over the name */
+
+        item.data = params[1].memref.buffer;
+        item.data_len = params[1].memref.size;
+    } else if (Comsst_GetItem(param_types, params,
+                   TEE_PARAM_TYPE_VALUE_INOUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                   &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    entry = Comsst_CacheFind(&item);
+    if (entry != NULL && entry->state == COMSST_CACHE_ABSENT) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    } else if (entry != NULL && entry->state == COMSST_CACHE_DATA) {
+        Comsst_ReplyData(Comsst_CacheData(entry), entry->data_len, &item,
+            params);
+        return TEE_SUCCESS;
+    } else if (entry == NULL && Comsst_FilterMiss(&item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(&item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            Comsst_PackCache(&item, &pack, idx);
+            Comsst_ReplyData(Comsst_PackData(&pack, idx),
+                pack.index[idx].data_len, &item, params);
+            Comsst_PackFree(&pack);
+            return TEE_SUCCESS;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item.storage, item.name, item.name_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(&item, res);
+        return res;
+    }
+
+    /* Even an item too large for the buffer is cached, for the next try */
+
+    res = Comsst_CacheLoad(obj, &item, &info, &codec, &entry);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    } else if (entry != NULL) {
+        Comsst_ReplyData(Comsst_CacheData(entry), entry->data_len, &item,
+            params);
+        goto exit;
+    }
+
+    /*
+     * Do not hand out a truncated item, only report its size so that the
+     * client can come back with a buffer that is large enough
+     */
+
+    if (info.dataSize > item.data_len) {
+        params[0].value.b = info.dataSize;
+        goto exit;
+    }
+
+    res = Comsst_ZRead(obj, codec, item.data, info.dataSize);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    params[0].value.b = info.dataSize;
+
+exit:
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/* Replace the data of an item, or create it, with item->data */
+
+static TEE_Result Comsst_PutItem(struct comsst_item* item)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    void* data;
+    uint8_t* buf = NULL;
+    size_t buf_len = 0;
+
+    Comsst_CacheDrop(item);
+
+    /* A small item goes to the container, a large one out of it */
+
+    if (COMSST_PACKED && item->data_len <= COMSST_PACKED_ITEM_MAX) {
+        res = Comsst_PackPut(item, item->data, item->data_len);
+        if (res == TEE_SUCCESS) {
+            res = Comsst_DeleteObject(item);
+        }
+
+        return res;
+    }
+
+    /*
+     * The digest is computed from a private copy of the data, the client
+     * could change the shared memory in between
+     */
+
+    data = TEE_Malloc(item->data_len + 1, TEE_MALLOC_FILL_ZERO);
+    if (data == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(data, item->data, item->data_len);
+    item->data = data;
+
+    res = Comsst_ZPack(item, item->data, item->data_len, &buf, &buf_len);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    /*
+     * The object is created with its data and digest, so that it is
+     * replaced in one storage commit and never seen empty
+     */
+
+    DMSG("TEE_CreatePersistentObject...\n");
+
+    res = Comsst_CreateObject(item, buf, buf_len, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+
+    if (COMSST_PACKED && res == TEE_SUCCESS) {
+        res = Comsst_PackRemove(item);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+            res = TEE_SUCCESS;
+        }
+    }
+
+exit:
+    TEE_Free(buf);
+    TEE_Free(data);
+    return res;
+}
+
+static TEE_Result Comsst_WriteItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    struct comsst_item item;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, &item)
+        != TEE_SUCCESS) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    return Comsst_PutItem(&item);
+}
+
+/*
+ * Write an item only if its data is still the expected one, so that a
+ * read-modify-write needs no lock in the normal world
+ */
+
+static TEE_Result Comsst_CasItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res;
+    struct comsst_item item;
+    struct comsst_digest stored;
+    uint8_t expected[COMSST_DIGEST_LEN];
+    bool absent = params[0].value.b & COMSST_ITEM_ABSENT;
+    bool is_digest = params[0].value.b & COMSST_ITEM_DIGEST;
+
+    if (TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_MEMREF_INPUT
+        || Comsst_GetItem(COMSST_PARAM_TYPES_HEAD(param_types), params,
+               TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+               &item)
+            != TEE_SUCCESS
+        || !item.split
+        || (is_digest && params[3].memref.size != COMSST_DIGEST_LEN)) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    /* The expected data is hashed first, it is in shared memory */
+
+    if (is_digest) {
+        memcpy(expected, params[3].memref.buffer, sizeof(expected));
+    } else if (!absent) {
+        res = Comsst_Digest(params[3].memref.buffer, params[3].memref.size,
+            expected);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+    }
+
+    res = Comsst_ItemDigest(&item, &stored);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        if (!absent) {
+            return TEE_ERROR_ACCESS_CONFLICT;
+        }
+    } else if (res != TEE_SUCCESS) {
+        return res;
+    } else if (absent
+        || (!is_digest && params[3].memref.size != stored.size)
+        || memcmp(expected, stored.digest, sizeof(expected)) != 0) {
+        return TEE_ERROR_ACCESS_CONFLICT;
+    }
+
+    return Comsst_PutItem(&item);
+}
+
+/*
+ * Verify the client's data against the digest of the item, so that the
+ * data of the item is not read. With COMSST_ITEM_DIGEST the client passes
+ * the digest of its data instead of the data.
+ */
+
+static TEE_Result Comsst_VerifyItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    struct comsst_item item;
+    struct comsst_digest stored;
+    uint8_t digest[COMSST_DIGEST_LEN];
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, &item)
+            != TEE_SUCCESS
+        || ((item.flags & COMSST_ITEM_DIGEST)
+            && item.data_len != COMSST_DIGEST_LEN)) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = Comsst_ItemDigest(&item, &stored);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    if (item.flags & COMSST_ITEM_DIGEST) {
+        memcpy(digest, item.data, sizeof(digest));
+    } else if (item.data_len != stored.size) {
+        return TEE_ERROR_GENERIC;
+    } else {
+        res = Comsst_Digest(item.data, item.data_len, digest);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+    }
+
+    if (memcmp(digest, stored.digest, sizeof(digest)) != 0) {
+        return TEE_ERROR_GENERIC;
+    }
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_StatItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_item item;
+    struct comsst_pack pack;
+    int32_t idx;
+    uint8_t codec;
+    bool stored = TEE_PARAM_TYPE_GET(param_types, 3)
+        == TEE_PARAM_TYPE_VALUE_OUTPUT;
+
+    if ((!stored && TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_NONE)
+        || Comsst_GetItem(COMSST_PARAM_TYPES_HEAD(param_types), params,
+               TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+               &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (Comsst_FilterMiss(&item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    /* A packed item has the flags of its container */
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(&item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            params[2].value.a = pack.index[idx].data_len;
+            params[2].value.b = pack.flags;
+
+            /* Its share of the container is its record and index entry */
+
+            if (stored) {
+                params[3].value.a = sizeof(struct comsst_pack_index)
+                    + pack.index[idx].name_len + pack.index[idx].data_len;
+                params[3].value.b = 0;
+            }
+
+            Comsst_PackFree(&pack);
+            return TEE_SUCCESS;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item.storage, item.name, item.name_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(&item, res);
+        return res;
+    }
+
+    /* A compressed item has the length of its data once decompressed */
+
+    if (stored) {
+        res = TEE_GetObjectInfo1(obj, &info);
+        if (res != TEE_SUCCESS) {
+            EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+
+        params[3].value.a = info.dataSize;
+        params[3].value.b = 1;
+    }
+
+    res = Comsst_ZInfo(obj, &info, &codec);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    params[2].value.a = info.dataSize;
+    params[2].value.b = info.handleFlags;
+
+exit:
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/*
+ * Give a batch operation the params it would have got as a single
+ * command, the name and the data area are passed in the split layout
+ */
+
+static uint32_t Comsst_BatchParams(const struct comsst_batch_op* op,
+    uint8_t* rec, TEE_Param params[4])
+{
+    memset(params, 0, sizeof(TEE_Param) * 4);
+    params[0].value.a = op->name_len;
+    params[0].value.b = op->is_deletable;
+    params[1].memref.buffer = rec + sizeof(*op);
+    params[1].memref.size = op->name_len;
+    params[2].memref.buffer = rec + sizeof(*op) + op->name_len;
+    params[2].memref.size = op->data_len;
+
+    switch (op->cmd) {
+    case TA_COMSST_CMD_CHK:
+    case TA_COMSST_CMD_DEL:
+        return TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
+            TEE_PARAM_TYPE_NONE);
+    case TA_COMSST_CMD_WR:
+    case TA_COMSST_CMD_VR:
+        return TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+            TEE_PARAM_TYPE_NONE);
+    case TA_COMSST_CMD_RD:
+        return TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+            TEE_PARAM_TYPE_NONE);
+    case TA_COMSST_CMD_STAT:
+        return TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+            TEE_PARAM_TYPE_NONE);
+    default:
+        return TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
+            TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    }
+}
+
+static TEE_Result Comsst_RunBatch(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    struct comsst_batch_op op;
+    TEE_Param op_params[4];
+    uint32_t op_param_types;
+    uint8_t* rec = params[1].memref.buffer;
+    size_t left = params[1].memref.size;
+    size_t rec_len;
+    uint32_t i;
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT,
+        TEE_PARAM_TYPE_MEMREF_INOUT,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    for (i = 0; i < params[0].value.a; i++) {
+        /*
+         * Work on a private copy of the header, the client could change
+         * the shared memory behind our back
+         */
+
+        if (left < sizeof(op)) {
+            EMSG("718fc92c\n");
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        memcpy(&op, rec, sizeof(op));
+        if (op.name_len > left - sizeof(op)
+            || op.data_len > left - sizeof(op) - op.name_len) {
+            EMSG("718fc92c\n");
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        op_param_types = Comsst_BatchParams(&op, rec, op_params);
+        op.status = Comsst_Dispatch(op.cmd, op_param_types, op_params);
+
+        if (op.status != TEE_SUCCESS) {
+            op.out_len = 0;
+        } else if (op.cmd == TA_COMSST_CMD_RD) {
+            op.out_len = op_params[0].value.b;
+        } else if (op.cmd == TA_COMSST_CMD_STAT) {
+            op.out_len = op_params[2].value.a;
+        } else {
+            op.out_len = 0;
+        }
+
+        memcpy(rec + offsetof(struct comsst_batch_op, status), &op.status,
+            sizeof(op.status) + sizeof(op.out_len));
+
+        rec_len = COMSST_BATCH_ALIGN(sizeof(op) + op.name_len + op.data_len);
+        if (rec_len > left) {
+            rec_len = left;
+        }
+
+        rec += rec_len;
+        left -= rec_len;
+
+        if (op.status != TEE_SUCCESS
+            && (params[0].value.b & COMSST_BATCH_STOP_ON_ERROR)) {
+            i++;
+            break;
+        }
+    }
+
+    params[0].value.a = i;
+    return TEE_SUCCESS;
+}
+
+/*
+ * The cursor is the position in the enumeration of the first object that
+ * was not returned yet, the objects before it are skipped. When that
+ * object is a container, the cursor also holds the first item in it that
+ * was not returned yet. A position that does not fit in its 16 bits can
+ * not be resumed from, the listing fails instead of restarting elsewhere.
+ */
+
+#define COMSST_LIST_POS_MAX 0xffff
+#define COMSST_LIST_CURSOR(pos, sub) ((pos) | ((uint32_t)(sub) << 16))
+#define COMSST_LIST_POS(cursor) ((cursor) & 0xffff)
+#define COMSST_LIST_SUB(cursor) ((cursor) >> 16)
+
+static TEE_Result Comsst_ListItems(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectEnumHandle objenum;
+    TEE_ObjectInfo info;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+    uint8_t name[COMSST_NAME_MAX];
+    size_t name_len;
+    uint8_t* prefix = params[1].memref.buffer;
+    size_t prefix_len = params[0].value.a;
+    uint8_t* page = params[2].memref.buffer;
+    size_t used = 0;
+    size_t rec_len;
+    uint32_t storage;
+    uint32_t cursor = params[3].value.a;
+    uint32_t count = 0;
+    uint32_t pos;
+    uint32_t sub;
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_VALUE_INOUT);
+
+    if (param_types != exp_param_types
+        || prefix_len > params[1].memref.size) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = TEE_AllocatePersistentObjectEnumerator(&objenum);
+    if (res != TEE_SUCCESS) {
+        EMSG("2e61b0f9:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    storage = params[0].value.b == 0 ? TEE_STORAGE_PRIVATE : TEE_STORAGE_USER;
+    res = TEE_StartPersistentObjectEnumerator(objenum, storage);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        cursor = 0;
+        res = TEE_SUCCESS;
+        goto out;
+    } else if (res != TEE_SUCCESS) {
+        EMSG("2e61b0f9:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    for (pos = 0;; pos++) {
+        id_len = sizeof(id);
+        res = TEE_GetNextPersistentObject(objenum, &info, id, &id_len);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+            cursor = 0;
+            res = TEE_SUCCESS;
+            break;
+        } else if (res != TEE_SUCCESS) {
+            EMSG("9c4d7e12:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+
+        /* An object without a name is not an item, skip it */
+
+        if (pos < COMSST_LIST_POS(cursor) || Comsst_IsMetaId(id, id_len)
+            || Comsst_EnumName(storage, id, id_len, name, &name_len)
+                != TEE_SUCCESS
+            || name_len < prefix_len
+            || memcmp(name, prefix, prefix_len) != 0) {
+            continue;
+        }
+
+        if (COMSST_PACKED && Comsst_PackIsId(id, id_len)) {
+            sub = pos == COMSST_LIST_POS(cursor) ? COMSST_LIST_SUB(cursor) : 0;
+            res = Comsst_PackList(storage, id, id_len, prefix, prefix_len,
+                page, params[2].memref.size, &used, &count, &sub);
+            if (res == TEE_ERROR_SHORT_BUFFER && count != 0) {
+                if (pos > COMSST_LIST_POS_MAX) {
+                    res = TEE_ERROR_OVERFLOW;
+                    goto exit;
+                }
+
+                cursor = COMSST_LIST_CURSOR(pos, sub);
+                res = TEE_SUCCESS;
+                break;
+            } else if (res != TEE_SUCCESS) {
+                goto exit;
+            }
+
+            continue;
+        }
+
+        rec_len = 1 + name_len - prefix_len;
+        if (used + rec_len > params[2].memref.size) {
+            if (count == 0) {
+                res = TEE_ERROR_SHORT_BUFFER;
+                goto exit;
+            }
+
+            if (pos > COMSST_LIST_POS_MAX) {
+                res = TEE_ERROR_OVERFLOW;
+                goto exit;
+            }
+
+            cursor = pos;
+            break;
+        }
+
+        page[used] = name_len - prefix_len;
+        memcpy(page + used + 1, name + prefix_len, name_len - prefix_len);
+        used += rec_len;
+        count++;
+    }
+
+out:
+    params[2].memref.size = used;
+    params[3].value.a = cursor;
+    params[3].value.b = count;
+exit:
+    TEE_FreePersistentObjectEnumerator(objenum);
+    return res;
+}
+
+/*
+ * Delete every object whose ID starts with prefix in one walk over the
+ * storage, returns the number of objects deleted in *count
+ */
+
+static TEE_Result Comsst_DeleteMatching(TEE_ObjectEnumHandle objenum,
+    uint32_t storage, const uint8_t* prefix, size_t prefix_len,
+    uint32_t* count)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_pack pack;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+    uint8_t name[COMSST_NAME_MAX];
+    size_t name_len;
+    uint32_t deleted;
+
+    *count = 0;
+    res = TEE_StartPersistentObjectEnumerator(objenum, storage);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    for (;;) {
+        id_len = sizeof(id);
+        res = TEE_GetNextPersistentObject(objenum, &info, id, &id_len);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+
+        if (Comsst_IsMetaId(id, id_len)
+            || Comsst_EnumName(storage, id, id_len, name, &name_len)
+                != TEE_SUCCESS
+            || name_len < prefix_len
+            || memcmp(name, prefix, prefix_len) != 0) {
+            continue;
+        }
+
+        /* A container counts for its items, a corrupt one is deleted too */
+
+        deleted = 1;
+        if (COMSST_PACKED && Comsst_PackIsId(id, id_len)
+            && Comsst_PackLoad(storage, id, id_len, &pack) == TEE_SUCCESS) {
+            deleted = pack.count > 0 ? pack.count : 1;
+            Comsst_PackFree(&pack);
+        }
+
+        res = TEE_OpenPersistentObject(storage, id, id_len,
+            TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+        if (res != TEE_SUCCESS) {
+            EMSG("c173d631:0x%08" PRIx32 "\n", res);
+            return res;
+        }
+
+        res = TEE_CloseAndDeletePersistentObject1(obj);
+        if (res != TEE_SUCCESS) {
+            EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
+            return res;
+        }
+
+        *count += deleted;
+    }
+}
+
+static TEE_Result Comsst_DeleteScope(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectEnumHandle objenum;
+    uint32_t storage;
+    uint32_t count;
+    uint32_t total = 0;
+    uint8_t prefix[COMSST_NAME_MAX];
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_VALUE_OUTPUT,
+        TEE_PARAM_TYPE_NONE);
+
+    /* An empty scope would match, and wipe, the whole storage */
+
+    if (param_types != exp_param_types || params[0].value.a == 0
+        || params[0].value.a > params[1].memref.size
+        || params[0].value.a > sizeof(prefix)) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    /* The cache must drop the very items that are deleted */
+
+    memcpy(prefix, params[1].memref.buffer, params[0].value.a);
+    storage = params[0].value.b == 0 ? TEE_STORAGE_PRIVATE : TEE_STORAGE_USER;
+    Comsst_CacheDropPrefix(storage, prefix, params[0].value.a);
+    Comsst_FilterReset(storage);
+
+    res = TEE_AllocatePersistentObjectEnumerator(&objenum);
+    if (res != TEE_SUCCESS) {
+        EMSG("2e61b0f9:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    /*
+     * Deleting objects while they are enumerated may make the enumerator
+     * skip some, walk the storage again until nothing matches anymore
+     */
+
+    do {
+        res = Comsst_DeleteMatching(objenum, storage, prefix,
+            params[0].value.a, &count);
+        total += count;
+    } while (res == TEE_ERROR_ITEM_NOT_FOUND && count != 0);
+
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        res = TEE_SUCCESS;
+    } else {
+        EMSG("9c4d7e12:0x%08" PRIx32 "\n", res);
+    }
+
+    params[2].value.a = total;
+    TEE_FreePersistentObjectEnumerator(objenum);
+    return res;
+}
+
+static TEE_Result Comsst_ReadChunk(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_item item;
+    struct comsst_pack pack;
+    int32_t idx;
+    size_t read_len = 0;
+    size_t size;
+    uint8_t* data;
+    uint8_t codec;
+
+    if (TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_VALUE_INOUT
+        || Comsst_GetItem(COMSST_PARAM_TYPES_HEAD(param_types), params,
+               TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+               &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (Comsst_FilterMiss(&item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(&item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            size = pack.index[idx].data_len;
+            if (params[3].value.a < size) {
+                read_len = size - params[3].value.a < item.data_len
+                    ? size - params[3].value.a
+                    : item.data_len;
+                memcpy(item.data, Comsst_PackData(&pack, idx)
+                        + params[3].value.a,
+                    read_len);
+            }
+
+            params[2].memref.size = read_len;
+            params[3].value.b = size;
+            Comsst_PackFree(&pack);
+            return TEE_SUCCESS;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    DMSG("TEE_OpenPersistentObject()...\n");
+
+    res = TEE_OpenPersistentObject(item.storage, item.name, item.name_len,
+        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        Comsst_OpenFailed(&item, res);
+        return res;
+    }
+
+    res = Comsst_ZInfo(obj, &info, &codec);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    /*
+     * Nothing is read past the end of the item, and a compressed one can
+     * only be read as a whole
+     */
+
+    if (codec == COMSST_Z_LZ4 && params[3].value.a < info.dataSize) {
+        res = Comsst_ZAlloc(obj, codec, info.dataSize, &data);
+        if (res != TEE_SUCCESS) {
+            goto exit;
+        }
+
+        read_len = info.dataSize - params[3].value.a < item.data_len
+            ? info.dataSize - params[3].value.a
+            : item.data_len;
+        memcpy(item.data, data + params[3].value.a, read_len);
+        TEE_Free(data);
+    } else if (params[3].value.a < info.dataSize) {
+        res = TEE_SeekObjectData(obj, params[3].value.a
+                + (codec == COMSST_Z_STORED ? sizeof(struct comsst_z_hdr) : 0),
+            TEE_DATA_SEEK_SET);
+        if (res != TEE_SUCCESS) {
+            EMSG("3f8a61c5:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+
+        DMSG("TEE_ReadObjectData()...\n");
+
+        res = TEE_ReadObjectData(obj, item.data, item.data_len, &read_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
+                res, read_len);
+            goto exit;
+        }
+    }
+
+    params[2].memref.size = read_len;
+    params[3].value.b = info.dataSize;
+
+exit:
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/*
+ * Write the data of the item at offset, then set the length of the item to
+ * new_size unless it is COMSST_PATCH_KEEP_SIZE. The length of the item is
+ * returned in *size.
+ */
+
+static TEE_Result Comsst_WriteRange(const struct comsst_item* item,
+    bool create, uint32_t offset, uint32_t new_size, uint32_t* size)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    struct comsst_pack pack;
+    struct comsst_z_hdr hdr;
+    int32_t idx;
+    size_t base = 0;
+
+    Comsst_CacheDrop(item);
+    if (!create && Comsst_FilterMiss(item)) {
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_PackGet(item, &pack, &idx);
+        if (res == TEE_SUCCESS) {
+            res = Comsst_PackWriteRange(item, &pack, idx, create, offset,
+                new_size, size);
+            Comsst_PackFree(&pack);
+            return res;
+        } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+            return res;
+        }
+    }
+
+    /*
+     * An item written in ranges is stored as is behind a header without a
+     * digest, so that no range makes it look compressed
+     */
+
+    if (create) {
+        DMSG("TEE_CreatePersistentObject...\n");
+
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, COMSST_Z_MAGIC, COMSST_Z_MAGIC_LEN);
+        hdr.codec = COMSST_Z_STORED;
+        base = sizeof(hdr);
+        res = Comsst_CreateObject(item, &hdr, base, &obj);
+        if (res != TEE_SUCCESS) {
+            EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+            return res;
+        }
+    } else {
+        DMSG("TEE_OpenPersistentObject()...\n");
+
+        res = TEE_OpenPersistentObject(item->storage, item->name,
+            item->name_len,
+            TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE, &obj);
+        if (res != TEE_SUCCESS) {
+            EMSG("c173d631:0x%08" PRIx32 "\n", res);
+            return res;
+        }
+
+        res = Comsst_ZUnpack(item, &obj, offset, &base);
+        if (res != TEE_SUCCESS) {
+            goto exit;
+        }
+    }
+
+    /* Writing past the end fills the gap with zeros */
+
+    if (item->data_len > 0) {
+        res = TEE_SeekObjectData(obj, base + offset, TEE_DATA_SEEK_SET);
+        if (res != TEE_SUCCESS) {
+            EMSG("3f8a61c5:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+
+        DMSG("TEE_WriteObjectData()...\n");
+
+        res = TEE_WriteObjectData(obj, item->data, item->data_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("7b12e0d6:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+    }
+
+    if (new_size != COMSST_PATCH_KEEP_SIZE) {
+        res = TEE_TruncateObjectData(obj, base + new_size);
+        if (res != TEE_SUCCESS) {
+            EMSG("d2a95c38:0x%08" PRIx32 "\n", res);
+            goto exit;
+        }
+    }
+
+    res = TEE_GetObjectInfo1(obj, &info);
+    if (res != TEE_SUCCESS) {
+        EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    *size = info.dataSize - base;
+
+exit:
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+    return res;
+}
+
+static TEE_Result Comsst_WriteChunk(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    struct comsst_item item;
+    uint32_t size;
+    TEE_Result res;
+
+    if (TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_VALUE_INOUT
+        || Comsst_GetItem(COMSST_PARAM_TYPES_HEAD(param_types), params,
+               TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+               &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    /* A created item is empty, the first chunk is always written */
+
+    res = Comsst_WriteRange(&item, params[3].value.b & COMSST_CHUNK_CREATE,
+        params[3].value.a, COMSST_PATCH_KEEP_SIZE, &size);
+    if (res == TEE_SUCCESS) {
+        params[3].value.b = size;
+    }
+
+    return res;
+}
+
+static TEE_Result Comsst_PatchItem(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    struct comsst_item item;
+    uint32_t size;
+    TEE_Result res;
+
+    if (TEE_PARAM_TYPE_GET(param_types, 3) != TEE_PARAM_TYPE_VALUE_INOUT
+        || Comsst_GetItem(COMSST_PARAM_TYPES_HEAD(param_types), params,
+               TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+               &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = Comsst_WriteRange(&item, false, params[3].value.a,
+        params[3].value.b, &size);
+    if (res == TEE_SUCCESS) {
+        params[3].value.b = size;
+    }
+
+    return res;
+}
+
+static TEE_Result Comsst_GetDigest(uint32_t param_types __unused,
+    TEE_Param params[4] __unused)
+{
+    TEE_Result res;
+    struct comsst_item item;
+    struct comsst_digest digest;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_OUTPUT, &item)
+            != TEE_SUCCESS
+        || !item.split || item.data_len < COMSST_DIGEST_LEN) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = Comsst_ItemDigest(&item, &digest);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    memcpy(item.data, digest.digest, COMSST_DIGEST_LEN);
+    params[2].memref.size = COMSST_DIGEST_LEN;
+    return TEE_SUCCESS;
+}
+
+/*
+ * A transaction stages item writes and deletes in the session, then
+ * commits them as a whole. The GP storage can only replace one object
+ * atomically, so a commit:
+ *
+ * - applies a single item directly,
+ * - rewrites the container once if all the items are packed in the same
+ *   one, which makes the whole transaction one storage commit,
+ * - otherwise stores the records in a journal object first, which is the
+ *   commit point, applies them and deletes the journal. A journal left by
+ *   a crash is applied again by the next instance, one left by a failure
+ *   before the next command, applying it twice does no harm.
+ *
+ * The items staged are not visible until the commit.
+ */
+
+#define COMSST_JOURNAL_MAGIC 0x4e524a43
+
+struct comsst_txn_rec {
+    uint32_t storage;
+    uint32_t flags; /* COMSST_ITEM_FLAGS() and COMSST_ITEM_REMOVE */
+    uint32_t name_len;
+    uint32_t data_len;
+};
+
+/*
+ * Get the item of the record at *pos of txn and move *pos to the next one,
+ * a journal read back from the storage is checked like a client's params
+ */
+
+static TEE_Result Comsst_TxnItem(const uint8_t* txn, size_t txn_len,
+    size_t* pos, struct comsst_item* item)
+{
+    struct comsst_txn_rec rec;
+
+    if (txn_len - *pos < sizeof(rec)) {
+        return TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    memcpy(&rec, txn + *pos, sizeof(rec));
+    *pos += sizeof(rec);
+    if ((rec.storage != TEE_STORAGE_PRIVATE
+            && rec.storage != TEE_STORAGE_USER)
+        || rec.name_len > sizeof(item->fullname)
+        || COMSST_ITEM_SCOPE_LEN(rec.flags) > rec.name_len
+        || (COMSST_PACKED
+            && COMSST_ITEM_SCOPE_LEN(rec.flags) + COMSST_PACK_SUFFIX_LEN
+                > TEE_OBJECT_ID_MAX_LEN)
+        || rec.data_len > txn_len - *pos
+        || rec.name_len > txn_len - *pos - rec.data_len) {
+        return TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    memset(item, 0, sizeof(*item));
+    item->storage = rec.storage;
+    item->flags = rec.flags;
+    item->scope_len = COMSST_ITEM_SCOPE_LEN(rec.flags);
+    item->fullname_len = rec.name_len;
+    memcpy(item->fullname, txn + *pos, rec.name_len);
+    item->data = (uint8_t*)txn + *pos + rec.name_len;
+    item->data_len = rec.data_len;
+    item->split = true;
+    *pos += rec.name_len + rec.data_len;
+    if (memchr(item->fullname, 0, item->fullname_len) != NULL) {
+        return TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    return Comsst_ObjectId(item);
+}
+
+/* Tell whether every record of txn is an item of the current layout */
+
+static TEE_Result Comsst_TxnCheck(const uint8_t* txn, size_t txn_len)
+{
+    TEE_Result res = TEE_SUCCESS;
+    struct comsst_item item;
+    size_t pos = 0;
+
+    while (pos < txn_len && res == TEE_SUCCESS) {
+        res = Comsst_TxnItem(txn, txn_len, &pos, &item);
+    }
+
+    return res;
+}
+
+/* Apply the records of txn one after another */
+
+static TEE_Result Comsst_TxnApply(const uint8_t* txn, size_t txn_len)
+{
+    TEE_Result res;
+    struct comsst_item item;
+    size_t pos = 0;
+
+    while (pos < txn_len) {
+        res = Comsst_TxnItem(txn, txn_len, &pos, &item);
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+
+        if (item.flags & COMSST_ITEM_REMOVE) {
+            res = Comsst_RemoveItem(&item);
+            if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+                res = TEE_SUCCESS;
+            }
+        } else {
+            res = Comsst_PutItem(&item);
+        }
+
+        if (res != TEE_SUCCESS) {
+            return res;
+        }
+    }
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * Apply txn with a single rewrite of a container if all its items belong
+ * there, *packed tells whether it could
+ */
+
+static TEE_Result Comsst_TxnApplyPacked(const uint8_t* txn, size_t txn_len,
+    bool* packed)
+{
+    TEE_Result res;
+    struct comsst_item first;
+    struct comsst_item item;
+    struct comsst_pack pack;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    size_t id_len;
+    uint8_t* buf;
+    size_t size;
+    size_t pos = 0;
+    int32_t idx;
+
+    *packed = false;
+    res = Comsst_TxnItem(txn, txn_len, &pos, &first);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    Comsst_PackId(&first, id, &id_len);
+    res = Comsst_PackLoad(first.storage, id, id_len, &pack);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    /*
+     * A delete of an item that is not in the container, maybe an object
+     * of its own, can not be part of the rewrite
+     */
+
+    for (pos = 0; pos < txn_len;) {
+        res = Comsst_TxnItem(txn, txn_len, &pos, &item);
+        if (res != TEE_SUCCESS) {
+            goto exit;
+        }
+
+        idx = Comsst_PackFind(&pack, &item);
+        if (item.storage != first.storage || item.scope_len != first.scope_len
+            || memcmp(item.fullname, first.fullname, first.scope_len) != 0
+            || ((item.flags & COMSST_ITEM_REMOVE) && idx < 0)
+            || item.data_len > COMSST_PACKED_ITEM_MAX) {
+            goto exit;
+        }
+
+        res = Comsst_PackBuild(&item, &pack, idx, item.data, item.data_len,
+            !(item.flags & COMSST_ITEM_REMOVE), &buf, &size);
+        if (res != TEE_SUCCESS) {
+            goto exit;
+        }
+
+        Comsst_PackFree(&pack);
+        memset(&pack, 0, sizeof(pack));
+        pack.buf = buf;
+        pack.size = size;
+        if (size > 0) {
+            res = Comsst_PackParse(&pack);
+            if (res != TEE_SUCCESS) {
+                goto exit;
+            }
+        }
+    }
+
+    res = Comsst_PackWrite(&first, pack.buf, pack.size);
+    if (res != TEE_SUCCESS) {
+        goto exit;
+    }
+
+    /* The container is the truth now, objects of the items are stale */
+
+    *packed = true;
+    for (pos = 0; pos < txn_len;) {
+        Comsst_TxnItem(txn, txn_len, &pos, &item);
+        Comsst_CacheDrop(&item);
+        if (item.flags & COMSST_ITEM_REMOVE) {
+            Comsst_FilterRemoved(&item);
+        } else {
+            Comsst_FilterAdd(&item);
+            Comsst_DeleteObject(&item);
+        }
+    }
+
+exit:
+    Comsst_PackFree(&pack);
+    return res;
+}
+
+static TEE_Result Comsst_JournalStore(const uint8_t* txn, size_t txn_len)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    uint32_t magic = COMSST_JOURNAL_MAGIC;
+
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, COMSST_JOURNAL_ID,
+        COMSST_JOURNAL_ID_LEN,
+        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
+        NULL, 0, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    /* The journal only counts once it is closed with its magic */
+
+    res = TEE_WriteObjectData(obj, &magic, sizeof(magic));
+    if (res == TEE_SUCCESS) {
+        res = TEE_WriteObjectData(obj, txn, txn_len);
+    }
+
+    if (res != TEE_SUCCESS) {
+        EMSG("7b12e0d6:0x%08" PRIx32 "\n", res);
+        TEE_CloseAndDeletePersistentObject1(obj);
+        return res;
+    }
+
+    TEE_CloseObject(obj);
+    return TEE_SUCCESS;
+}
+
+/* Delete the journal of a commit that has been applied */
+
+static TEE_Result Comsst_JournalDrop(void)
+{
+    TEE_ObjectHandle obj;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, COMSST_JOURNAL_ID,
+        COMSST_JOURNAL_ID_LEN, TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    res = TEE_CloseAndDeletePersistentObject1(obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
+    }
+
+    return res;
+}
+
+/*
+ * Apply and delete the journal if there is one. A journal that can never
+ * be applied, e.g. one written under another layout, is deleted rather
+ * than failing every commit after it.
+ */
+
+static TEE_Result Comsst_JournalRecover(void)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj;
+    TEE_ObjectInfo info;
+    uint8_t* buf = NULL;
+    size_t read_len = 0;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, COMSST_JOURNAL_ID,
+        COMSST_JOURNAL_ID_LEN,
+        TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE_META, &obj);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        return TEE_SUCCESS;
+    } else if (res != TEE_SUCCESS) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    res = TEE_GetObjectInfo1(obj, &info);
+    if (res != TEE_SUCCESS) {
+        EMSG("5b0e3d4a:0x%08" PRIx32 "\n", res);
+        goto exit;
+    }
+
+    buf = TEE_Malloc(info.dataSize + 1, TEE_MALLOC_FILL_ZERO);
+    if (buf == NULL) {
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    res = TEE_ReadObjectData(obj, buf, info.dataSize, &read_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n", res, read_len);
+        goto exit;
+    }
+
+    /* A journal that was never completed was never committed either */
+
+    if (read_len >= sizeof(uint32_t)
+        && *(uint32_t*)buf == COMSST_JOURNAL_MAGIC) {
+        res = Comsst_TxnCheck(buf + sizeof(uint32_t),
+            read_len - sizeof(uint32_t));
+        if (res == TEE_ERROR_CORRUPT_OBJECT
+            || res == TEE_ERROR_BAD_PARAMETERS) {
+            EMSG("b81f4c6a:0x%08" PRIx32 "\n", res);
+        } else if (res != TEE_SUCCESS) {
+            goto exit;
+        } else {
+            res = Comsst_TxnApply(buf + sizeof(uint32_t),
+                read_len - sizeof(uint32_t));
+            if (res != TEE_SUCCESS) {
+                EMSG("3c9e5a71:0x%08" PRIx32 "\n", res);
+                goto exit;
+            }
+        }
+    }
+
+    res = TEE_CloseAndDeletePersistentObject1(obj);
+    obj = TEE_HANDLE_NULL;
+    if (res != TEE_SUCCESS) {
+        EMSG("69aa1fce:0x%08" PRIx32 "\n", res);
+    }
+
+exit:
+    if (obj != TEE_HANDLE_NULL) {
+        TEE_CloseObject(obj);
+    }
+
+    TEE_Free(buf);
+    g_comsst_journal_left = res != TEE_SUCCESS;
+    return res;
+}
+
+/* Copy an item write or delete to the transaction of the session */
+
+static TEE_Result Comsst_TxnStage(struct comsst_session* session,
+    uint32_t param_types, TEE_Param params[4])
+{
+    struct comsst_item item;
+    struct comsst_txn_rec rec;
+    uint8_t* txn;
+    size_t rec_len;
+
+    if (Comsst_GetItem(param_types, params, TEE_PARAM_TYPE_VALUE_INPUT,
+            TEE_PARAM_TYPE_MEMREF_INPUT, &item)
+            != TEE_SUCCESS
+        || !item.split) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (!session->in_txn) {
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    if (item.flags & COMSST_ITEM_REMOVE) {
+        item.data_len = 0;
+    }
+
+    rec_len = sizeof(rec) + item.fullname_len + item.data_len;
+    if (item.data_len > CONFIG_TA_COMSST_TXN_SIZE
+        || rec_len > CONFIG_TA_COMSST_TXN_SIZE - session->txn_len) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    txn = TEE_Realloc(session->txn, session->txn_len + rec_len);
+    if (txn == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    rec.storage = item.storage;
+    rec.flags = item.flags;
+    rec.name_len = item.fullname_len;
+    rec.data_len = item.data_len;
+    memcpy(txn + session->txn_len, &rec, sizeof(rec));
+    memcpy(txn + session->txn_len + sizeof(rec), item.fullname,
+        item.fullname_len);
+    memcpy(txn + session->txn_len + sizeof(rec) + item.fullname_len,
+        item.data, item.data_len);
+    session->txn = txn;
+    session->txn_len += rec_len;
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_TxnCommit(struct comsst_session* session)
+{
+    TEE_Result res;
+    struct comsst_item item;
+    size_t pos = 0;
+    bool packed = false;
+
+    /* The journal of a commit that could not be applied goes first */
+
+    res = Comsst_JournalRecover();
+    if (res != TEE_SUCCESS || session->txn_len == 0) {
+        return res;
+    }
+
+    res = Comsst_TxnItem(session->txn, session->txn_len, &pos, &item);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    if (pos == session->txn_len) {
+        return Comsst_TxnApply(session->txn, session->txn_len);
+    }
+
+    if (COMSST_PACKED) {
+        res = Comsst_TxnApplyPacked(session->txn, session->txn_len,
+            &packed);
+        if (res != TEE_SUCCESS || packed) {
+            return res;
+        }
+    }
+
+    res = Comsst_JournalStore(session->txn, session->txn_len);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    /*
+     * Committed, what is left to apply is done by the recovery before the
+     * next command, once applied the journal only has to go
+     */
+
+    res = Comsst_TxnApply(session->txn, session->txn_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("3c9e5a71:0x%08" PRIx32 "\n", res);
+        g_comsst_journal_left = true;
+    } else if (Comsst_JournalDrop() != TEE_SUCCESS) {
+        g_comsst_journal_left = true;
+    }
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result Comsst_Txn(void* sess_ctx, uint32_t cmd_id,
+    uint32_t param_types, TEE_Param params[4])
+{
+    struct comsst_session* session = sess_ctx;
+    TEE_Result res;
+
+    if (cmd_id == TA_COMSST_CMD_TXN_STAGE) {
+        return Comsst_TxnStage(session, param_types, params);
+    }
+
+    if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+            TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE)) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (cmd_id == TA_COMSST_CMD_TXN_BEGIN) {
+        res = session->in_txn ? TEE_ERROR_BAD_STATE : TEE_SUCCESS;
+        session->in_txn = true;
+        return res;
+    } else if (!session->in_txn) {
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    res = TEE_SUCCESS;
+    if (cmd_id == TA_COMSST_CMD_TXN_COMMIT) {
+        res = Comsst_TxnCommit(session);
+    }
+
+    /* Commit or abort, the transaction is over either way */
+
+    TEE_Free(session->txn);
+    session->txn = NULL;
+    session->txn_len = 0;
+    session->in_txn = false;
     return res;
 }
 
 struct user_ta_head comsst_user_ta_head = {
     .uuid = TA_COMSST_UUID,
     .name = "COMSST",
-    .flags = TA_FLAG_USER_MODE,
+    .flags = COMSST_TA_FLAGS,
     .create_entry_point = COMSST_TA_CreateEntryPoint,
     .destroy_entry_point = COMSST_TA_DestroyEntryPoint,
     .open_session_entry_point = COMSST_TA_OpenSessionEntryPoint,
@@ -39,6 +39,14 @@ static TEE_Result TA_Store_Key(uint32_t param_types __unused,
     TEE_Param params[4] __unused);
 static TEE_Result TA_Get_HMAC(uint32_t param_types __unused,
     TEE_Param params[4] __unused);
+static TEE_Result TA_Get_HMAC_Batch(uint32_t param_types,
+    TEE_Param params[4]);
+static TEE_Result TA_HMAC_Init(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4] __unused);
+static TEE_Result TA_HMAC_Update(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4]);
+static TEE_Result TA_HMAC_Final(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4]);
 
 /* | Object Type           | Possible Key Sizes                            |
  * +-----------------------+-----------------------------------------------+
@@ -47,9 +55,122 @@ static TEE_Result TA_Get_HMAC(uint32_t param_types __unused,
 #define MAX_KEY_SIZE 128
 #define MIN_KEY_SIZE 24
 
-static TEE_Result hmac_sha256(uint8_t* key, uint32_t keylen,
-    uint8_t* in, uint32_t inlen,
-    uint8_t* out, size_t* outlen)
+/* The 16 bytes triad key is zero padded to a 32 bytes hmac key */
+
+#define HMAC_KEY_SIZE 32
+
+/* Per session state of the multi-part HMAC commands */
+
+struct triad_session {
+    TEE_OperationHandle hmac_op;
+    bool hmac_active;
+};
+
+#define TRIAD_DID_SIZE 8
+#define TRIAD_KEY_SIZE 16
+
+/*
+ * triad_did and triad_key only change at factory provisioning, so they are
+ * read from secure storage once per TA instance and served from RAM after.
+ */
+struct triad_cache {
+    const char* name;
+    size_t size;
+    bool loaded;
+    uint8_t data[TRIAD_KEY_SIZE];
+};
+
+static struct triad_cache g_did = {
+    .name = TA_OBJECT_NAME_DID,
+    .size = TRIAD_DID_SIZE,
+};
+
+static struct triad_cache g_key = {
+    .name = TA_OBJECT_NAME_KEY,
+    .size = TRIAD_KEY_SIZE,
+};
+
+static TEE_Result triad_cache_load(struct triad_cache* cache)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+    size_t read_len;
+
+    if (cache->loaded) {
+        return TEE_SUCCESS;
+    }
+
+    /* The object id includes the terminating nul, as it always did */
+
+    DMSG("TEE_OpenPersistentObject(%s)...\n", cache->name);
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, cache->name,
+        strlen(cache->name) + 1, TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("c173d631:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    DMSG("TEE_ReadObjectData()...\n");
+    res = TEE_ReadObjectData(obj, cache->data, cache->size, &read_len);
+
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+
+    if ((res != TEE_SUCCESS) || (read_len != cache->size)) {
+        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
+            res, read_len);
+        return res != TEE_SUCCESS ? res : TEE_ERROR_CORRUPT_OBJECT;
+    }
+
+    cache->loaded = true;
+    return TEE_SUCCESS;
+}
+
+static TEE_Result triad_cache_store(struct triad_cache* cache,
+    const void* data, size_t size)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_ObjectHandle obj;
+
+    /* Drop the old value first, it is stale whatever happens below */
+
+    cache->loaded = false;
+
+    DMSG("TEE_CreatePersistentObject(%s)...\n", cache->name);
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
+        cache->name, strlen(cache->name) + 1,
+        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
+        NULL, 0,
+        &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
+        return res;
+    }
+
+    DMSG("TEE_WriteObjectData()...\n");
+
+    res = TEE_WriteObjectData(obj, data, size);
+
+    DMSG("TEE_CloseObject()...\n");
+    TEE_CloseObject(obj);
+
+    if (res == TEE_SUCCESS) {
+        memcpy(cache->data, data, size);
+        cache->loaded = true;
+    }
+
+    return res;
+}
+
+/*
+ * HMAC operation keyed with triad_key. It is set up on the first
+ * TA_TRIAD_CMD_GET_HMAC and kept for the life of the TA instance, so later
+ * requests neither touch secure storage nor rebuild the key object.
+ */
+static TEE_OperationHandle g_hmac_op = TEE_HANDLE_NULL;
+
+static TEE_Result hmac_sha256_setup(uint8_t* key, uint32_t keylen,
+    TEE_OperationHandle* op)
 {
     TEE_Attribute attr = { 0 };
     TEE_ObjectHandle key_handle = TEE_HANDLE_NULL;
@@ -88,20 +209,57 @@ static TEE_Result hmac_sha256(uint8_t* key, uint32_t keylen,
         goto exit;
     }
 
-    TEE_MACInit(op_handle, NULL, 0);
-    TEE_MACUpdate(op_handle, in, inlen);
-    res = TEE_MACComputeFinal(op_handle, NULL, 0, out, outlen);
+    *op = op_handle;
+    op_handle = TEE_HANDLE_NULL;
 
 exit:
     if (op_handle != TEE_HANDLE_NULL) {
         TEE_FreeOperation(op_handle);
     }
 
+    /* The operation keeps its own copy of the key */
+
     TEE_FreeTransientObject(key_handle);
 
     return res;
 }
 
+static void hmac_op_invalidate(void)
+{
+    if (g_hmac_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(g_hmac_op);
+        g_hmac_op = TEE_HANDLE_NULL;
+    }
+}
+
+static TEE_Result hmac_op_get(TEE_OperationHandle* op)
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    uint8_t key[HMAC_KEY_SIZE];
+
+    if (g_hmac_op != TEE_HANDLE_NULL) {
+        TEE_ResetOperation(g_hmac_op);
+        *op = g_hmac_op;
+        return TEE_SUCCESS;
+    }
+
+    res = triad_cache_load(&g_key);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    memset(key, 0, sizeof(key));
+    memcpy(key, g_key.data, TRIAD_KEY_SIZE);
+    res = hmac_sha256_setup(key, sizeof(key), &g_hmac_op);
+    memset(key, 0, sizeof(key));
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    *op = g_hmac_op;
+    return TEE_SUCCESS;
+}
+
 /*
  * Called when the instance of the TA is created. This is the first call in
  * the TA.
@@ -120,6 +278,10 @@ TEE_Result TRIAD_TA_CreateEntryPoint(void)
 void TRIAD_TA_DestroyEntryPoint(void)
 {
     DMSG("has been called\n");
+
+    hmac_op_invalidate();
+    memset(g_key.data, 0, sizeof(g_key.data));
+    g_key.loaded = false;
 }
 
 /*
@@ -132,6 +294,7 @@ TEE_Result TRIAD_TA_OpenSessionEntryPoint(uint32_t param_types,
     TEE_Param __maybe_unused params[4],
     void __maybe_unused** sess_ctx)
 {
+    struct triad_session* sess;
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE,
@@ -142,6 +305,14 @@ TEE_Result TRIAD_TA_OpenSessionEntryPoint(uint32_t param_types,
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
+
+    sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+    if (sess == NULL) {
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    sess->hmac_op = TEE_HANDLE_NULL;
+    *sess_ctx = sess;
     /*
      * The DMSG() macro is non-standard, TEE Internal API doesn't
      * specify any means to logging from a TA.
@@ -158,7 +329,13 @@ TEE_Result TRIAD_TA_OpenSessionEntryPoint(uint32_t param_types,
  */
 void TRIAD_TA_CloseSessionEntryPoint(void __maybe_unused* sess_ctx)
 {
-    (void)&sess_ctx; /* Unused parameter */
+    struct triad_session* sess = sess_ctx;
+
+    if (sess->hmac_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(sess->hmac_op);
+    }
+
+    TEE_Free(sess);
     DMSG("Goodbye!\n");
 }
 
@@ -171,8 +348,6 @@ TEE_Result TRIAD_TA_InvokeCommandEntryPoint(void __maybe_unused* sess_ctx,
     uint32_t cmd_id,
     uint32_t param_types, TEE_Param params[4])
 {
-    (void)&sess_ctx; /* Unused parameter */
-
     DMSG("cmd: 0x%08" PRIx32 "\n", cmd_id);
     switch (cmd_id) {
     case TA_TRIAD_CMD_STORE_KEY:
@@ -185,6 +360,14 @@ TEE_Result TRIAD_TA_InvokeCommandEntryPoint(void __maybe_unused* sess_ctx,
         return TA_Load_DID(param_types, params);
     case TA_TRIAD_CMD_GET_HMAC:
         return TA_Get_HMAC(param_types, params);
+    case TA_TRIAD_CMD_GET_HMAC_BATCH:
+        return TA_Get_HMAC_Batch(param_types, params);
+    case TA_TRIAD_CMD_HMAC_INIT:
+        return TA_HMAC_Init(sess_ctx, param_types, params);
+    case TA_TRIAD_CMD_HMAC_UPDATE:
+        return TA_HMAC_Update(sess_ctx, param_types, params);
+    case TA_TRIAD_CMD_HMAC_FINAL:
+        return TA_HMAC_Final(sess_ctx, param_types, params);
     default:
         EMSG("ee962c07: 0x%08" PRIx32 "\n", cmd_id);
         return TEE_ERROR_BAD_PARAMETERS;
@@ -195,36 +378,23 @@ static TEE_Result TA_Store_Key(uint32_t param_types __unused,
     TEE_Param params[4] __unused)
 {
     TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint8_t name[] = TA_OBJECT_NAME_KEY;
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE);
 
-    if (param_types != exp_param_types || params[0].memref.size != 16) {
+    if (param_types != exp_param_types
+        || params[0].memref.size != TRIAD_KEY_SIZE) {
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_CreatePersistentObject(%s)...\n", name);
-    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-        name, sizeof(name),
-        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
-        NULL, 0,
-        &obj);
-    if (res != TEE_SUCCESS) {
-        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
-        return res;
-    }
-
-    DMSG("TEE_WriteObjectData()...\n");
-
-    res = TEE_WriteObjectData(obj, params[0].memref.buffer,
+    res = triad_cache_store(&g_key, params[0].memref.buffer,
         params[0].memref.size);
 
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
+    /* The cached hmac operation is keyed with the old key */
+
+    hmac_op_invalidate();
 
     return res;
 }
@@ -233,113 +403,65 @@ static TEE_Result TA_Load_Key(uint32_t param_types __unused,
     TEE_Param params[4] __unused)
 {
     TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint8_t name[] = TA_OBJECT_NAME_KEY;
-    size_t read_len;
 
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE);
 
-    if (param_types != exp_param_types || params[0].memref.size != 16) {
+    if (param_types != exp_param_types
+        || params[0].memref.size != TRIAD_KEY_SIZE) {
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, name, sizeof(name),
-        TEE_DATA_FLAG_ACCESS_READ, &obj);
-    if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
-        return res;
-    }
-
-    DMSG("TEE_ReadObjectData()...\n");
-    res = TEE_ReadObjectData(obj, params[0].memref.buffer, 16, &read_len);
-    if ((res != TEE_SUCCESS) || (read_len != 16)) {
-        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
-            res, read_len);
+    res = triad_cache_load(&g_key);
+    if (res == TEE_SUCCESS) {
+        memcpy(params[0].memref.buffer, g_key.data, TRIAD_KEY_SIZE);
     }
 
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
     return res;
 }
 
 static TEE_Result TA_Store_DID(uint32_t param_types __unused,
     TEE_Param params[4] __unused)
 {
-    TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint8_t name[] = TA_OBJECT_NAME_DID;
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE);
 
-    if (param_types != exp_param_types || params[0].memref.size != 8) {
+    if (param_types != exp_param_types
+        || params[0].memref.size != TRIAD_DID_SIZE) {
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_CreatePersistentObject(%s)...\n", name);
-    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-        name, sizeof(name),
-        TEE_DATA_FLAG_ACCESS_WRITE_META | TEE_DATA_FLAG_ACCESS_READ | TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_OVERWRITE, NULL,
-        NULL, 0,
-        &obj);
-    if (res != TEE_SUCCESS) {
-        EMSG("e23a89fe:0x%08" PRIx32 "\n", res);
-        return res;
-    }
-
-    DMSG("TEE_WriteObjectData()...\n");
-
-    res = TEE_WriteObjectData(obj, params[0].memref.buffer,
+    return triad_cache_store(&g_did, params[0].memref.buffer,
         params[0].memref.size);
-
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
-
-    return res;
 }
 
 static TEE_Result TA_Load_DID(uint32_t param_types __unused,
     TEE_Param params[4] __unused)
 {
     TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint8_t name[] = TA_OBJECT_NAME_DID;
-    size_t read_len;
 
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE);
 
-    if (param_types != exp_param_types || params[0].memref.size != 8) {
+    if (param_types != exp_param_types
+        || params[0].memref.size != TRIAD_DID_SIZE) {
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, name, sizeof(name),
-        TEE_DATA_FLAG_ACCESS_READ, &obj);
-    if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
-        return res;
-    }
-
-    DMSG("TEE_ReadObjectData()...\n");
-    res = TEE_ReadObjectData(obj, params[0].memref.buffer, 8, &read_len);
-    if ((res != TEE_SUCCESS) || (read_len != 8)) {
-        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
-            res, read_len);
+    res = triad_cache_load(&g_did);
+    if (res == TEE_SUCCESS) {
+        memcpy(params[0].memref.buffer, g_did.data, TRIAD_DID_SIZE);
     }
 
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
     return res;
 }
 
@@ -347,12 +469,9 @@ static TEE_Result TA_Get_HMAC(uint32_t param_types __unused,
     TEE_Param params[4] __unused)
 {
     TEE_Result res = TEE_ERROR_GENERIC;
-    TEE_ObjectHandle obj;
-    uint8_t name[] = TA_OBJECT_NAME_KEY;
-    size_t read_len;
-    uint8_t key[32];
+    TEE_OperationHandle op;
+    size_t hmac_len;
     uint8_t hmac[32];
-    int ret;
 
     uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT,
         TEE_PARAM_TYPE_VALUE_INPUT,
@@ -360,55 +479,208 @@ static TEE_Result TA_Get_HMAC(uint32_t param_types __unused,
         TEE_PARAM_TYPE_NONE);
 
     if (param_types != exp_param_types || params[0].memref.size < 32
-        || params[1].value.a == 0) {
+        || params[1].value.a == 0
+        || params[1].value.a > params[0].memref.size) {
         EMSG("718fc92c\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    DMSG("TEE_OpenPersistentObject()...\n");
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, name, sizeof(name),
-        TEE_DATA_FLAG_ACCESS_READ, &obj);
+    res = hmac_op_get(&op);
     if (res != TEE_SUCCESS) {
-        EMSG("c173d631:0x%08" PRIx32 "\n", res);
         return res;
     }
 
-    DMSG("TEE_ReadObjectData()...\n");
+    hmac_len = sizeof(hmac);
+    TEE_MACInit(op, NULL, 0);
+    TEE_MACUpdate(op, params[0].memref.buffer, params[1].value.a);
+    res = TEE_MACComputeFinal(op, NULL, 0, hmac, &hmac_len);
 
-    memset(key, 0, sizeof(key));
-    res = TEE_ReadObjectData(obj, key, 16, &read_len);
-    if ((res != TEE_SUCCESS) || (read_len != 16)) {
-        EMSG("8d4785a7:0x%08" PRIx32 ",%zu\n",
-            res, read_len);
+    if (res != TEE_SUCCESS || hmac_len != 32) {
+        EMSG("f2e10a84:0x%08" PRIx32 "\n", res);
+        res = TEE_ERROR_GENERIC;
+    } else {
+        memcpy(params[0].memref.buffer, hmac, 32);
+    }
+
+    return res;
+}
+
+/*
+ * params[0] holds count records packed back to back, each one is a 32 bits
+ * length in native byte order followed by that many bytes of data. The MAC
+ * of record i is written at offset 32 * i of params[1].
+ */
+
+static TEE_Result TA_Get_HMAC_Batch(uint32_t param_types,
+    TEE_Param params[4])
+{
+    TEE_Result res = TEE_ERROR_GENERIC;
+    TEE_OperationHandle op;
+    uint8_t* in = params[0].memref.buffer;
+    uint8_t* out = params[1].memref.buffer;
+    size_t left = params[0].memref.size;
+    uint32_t count = params[2].value.a;
+    size_t hmac_len;
+    uint32_t len;
+    uint32_t i;
+
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types || count == 0
+        || params[1].memref.size / 32 < count) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = hmac_op_get(&op);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (left < sizeof(len)) {
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        memcpy(&len, in, sizeof(len));
+        in += sizeof(len);
+        left -= sizeof(len);
+
+        if (len > left) {
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        hmac_len = 32;
+        TEE_MACInit(op, NULL, 0);
+        TEE_MACUpdate(op, in, len);
+        res = TEE_MACComputeFinal(op, NULL, 0, out + 32 * i, &hmac_len);
+        if (res != TEE_SUCCESS || hmac_len != 32) {
+            EMSG("f2e10a84:0x%08" PRIx32 "\n", res);
+            return TEE_ERROR_GENERIC;
+        }
+
+        in += len;
+        left -= len;
+    }
+
+    params[1].memref.size = 32 * count;
+    return TEE_SUCCESS;
+}
+
+/*
+ * Start a multi-part HMAC on this session. The session gets its own copy
+ * of the cached keyed operation, so several sessions can stream at the
+ * same time and TA_Get_HMAC keeps working in between.
+ */
+
+static TEE_Result TA_HMAC_Init(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4] __unused)
+{
+    struct triad_session* sess = sess_ctx;
+    TEE_OperationHandle op;
+    TEE_Result res;
+
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    sess->hmac_active = false;
+
+    res = hmac_op_get(&op);
+    if (res != TEE_SUCCESS) {
+        return res;
+    }
+
+    if (sess->hmac_op == TEE_HANDLE_NULL) {
+        res = TEE_AllocateOperation(&sess->hmac_op, TEE_ALG_HMAC_SHA256,
+            TEE_MODE_MAC, HMAC_KEY_SIZE * 8);
         if (res != TEE_SUCCESS) {
-            return TEE_SUCCESS;
-        } else {
-            goto exit;
+            EMSG("9476476a:0x%08" PRIx32 "\n", res);
+            return res;
         }
     }
 
-    read_len = 32;
-    ret = hmac_sha256(key, 32,
-        (uint8_t*)params[0].memref.buffer,
-        params[1].value.a, hmac, &read_len);
+    TEE_CopyOperation(sess->hmac_op, op);
+    TEE_MACInit(sess->hmac_op, NULL, 0);
+    sess->hmac_active = true;
 
-    if (ret != 0 || read_len != 32) {
-        EMSG("f2e10a84:%d\n", ret);
-        res = TEE_ERROR_GENERIC;
-    } else {
-        memcpy(params[0].memref.buffer, hmac, 32);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result TA_HMAC_Update(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4])
+{
+    struct triad_session* sess = sess_ctx;
+
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-exit:
-    DMSG("TEE_CloseObject()...\n");
-    TEE_CloseObject(obj);
-    return res;
+    if (!sess->hmac_active) {
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    TEE_MACUpdate(sess->hmac_op, params[0].memref.buffer,
+        params[0].memref.size);
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result TA_HMAC_Final(void* sess_ctx, uint32_t param_types,
+    TEE_Param params[4])
+{
+    struct triad_session* sess = sess_ctx;
+    TEE_Result res;
+    size_t hmac_len;
+
+    uint32_t exp_param_types = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp_param_types || params[0].memref.size < 32) {
+        EMSG("718fc92c\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (!sess->hmac_active) {
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    sess->hmac_active = false;
+
+    hmac_len = params[0].memref.size;
+    res = TEE_MACComputeFinal(sess->hmac_op, NULL, 0,
+        params[0].memref.buffer, &hmac_len);
+    if (res != TEE_SUCCESS || hmac_len != 32) {
+        EMSG("f2e10a84:0x%08" PRIx32 "\n", res);
+        return TEE_ERROR_GENERIC;
+    }
+
+    params[0].memref.size = hmac_len;
+    return TEE_SUCCESS;
 }
 
 struct user_ta_head triad_user_ta_head = {
     .uuid = TA_TRIAD_UUID,
     .name = "TRIAD",
-    .flags = TA_FLAG_USER_MODE,
+    .flags = TA_FLAG_USER_MODE | TA_FLAG_SINGLE_INSTANCE
+        | TA_FLAG_MULTI_SESSION | TA_FLAG_INSTANCE_KEEP_ALIVE,
     .create_entry_point = TRIAD_TA_CreateEntryPoint,
     .destroy_entry_point = TRIAD_TA_DestroyEntryPoint,
     .open_session_entry_point = TRIAD_TA_OpenSessionEntryPoint,